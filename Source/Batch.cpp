@@ -0,0 +1,242 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#include "Batch.hpp"
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include "Constants.hpp"
+#include "Utilities.hpp"
+#include "Decoder.hpp"
+#include "Generator.hpp"
+#include "Exporter.hpp"
+#include "ThreadPool.hpp"
+
+
+namespace
+{
+	struct Job
+	{
+		std::string file_name;
+		float duration{}; // Seconds.
+		size_t memory{}; // Bytes.
+	};
+
+
+	// Jobs wait here until their estimated memory fits within the budget. A job larger
+	// than the whole budget runs once no other job is running.
+	std::mutex memory_mutex;
+	std::condition_variable memory_released;
+	size_t memory_in_use{};
+
+	std::mutex output_mutex;
+
+
+	std::vector<std::string> find_audio_files(const std::string& directory)
+	{
+		if(!std::filesystem::is_directory(directory))
+			throw std::runtime_error{"Could not open the directory \""+directory+"\"."};
+
+		std::vector<std::string> file_names;
+
+		for(const std::filesystem::directory_entry& entry :
+			std::filesystem::directory_iterator{directory})
+		{
+			if(!entry.is_regular_file()) continue;
+
+			std::string extension{entry.path().extension().string()};
+			if(extension.empty()) continue;
+
+			extension.erase(extension.begin());
+			std::transform(extension.begin(), extension.end(), extension.begin(),
+				[](unsigned char character){ return std::tolower(character); });
+
+			if(LV::Utilities::is_supported(extension, LV::Constants::supported_audio_formats))
+				file_names.emplace_back(entry.path().string());
+		}
+
+		std::sort(file_names.begin(), file_names.end());
+		return file_names;
+	}
+
+
+	// Returns the number of samples in the file, estimated from its size and bit rate if
+	// its container does not record its duration, or zero if neither is known.
+	size_t estimate_sample_count(const LV::Decoder& decoder, const std::string& file_name)
+	{
+		const size_t sample_count{decoder.get_estimated_sample_count()};
+		const int64_t bit_rate{decoder.get_bit_rate()};
+		if(sample_count > 0 || bit_rate <= 0) return sample_count;
+
+		const double seconds{std::filesystem::file_size(file_name)*8./bit_rate};
+		return static_cast<size_t>(seconds*decoder.get_sample_rate());
+	}
+
+
+	// Returns the peak memory of a job, including its export. A job of unknown length
+	// claims the whole budget, so it runs alone.
+	size_t get_job_memory(const LV::Generator& generator, const std::string& file_name,
+		int sample_rate, size_t sample_count)
+	{
+		if(sample_count == 0)
+		{
+			std::cout<<"WARNING: The length of \""<<file_name<<"\" is unknown, so it "
+				"will be generated alone.\n";
+
+			return LV::Constants::batch_memory_budget;
+		}
+
+		return generator.estimate_memory(sample_rate, sample_count)+
+			LV::Exporter::estimate_memory(generator.estimate_vertex_count(
+			sample_rate, sample_count));
+	}
+
+
+	// Opens each file to find its duration and the memory its generation will need.
+	// Files that cannot be opened are reported and skipped.
+	std::vector<Job> plan_jobs(const LV::Generator& generator,
+		const std::vector<std::string>& file_names, int* failed)
+	{
+		std::vector<Job> jobs;
+		const unsigned draft_sample_rate{static_cast<unsigned>(
+			generator.get_configuration().draft_sample_rate)};
+
+		for(const std::string& file_name : file_names)
+		{
+			try
+			{
+				const LV::Decoder decoder{file_name, draft_sample_rate};
+				const int sample_rate{decoder.get_sample_rate()};
+				const size_t sample_count{estimate_sample_count(decoder, file_name)};
+
+				jobs.push_back({file_name, static_cast<float>(sample_count)/sample_rate,
+					get_job_memory(generator, file_name, sample_rate, sample_count)});
+			}
+			catch(std::exception& error)
+			{
+				std::cout<<"ERROR: "<<file_name<<": "<<error.what()<<'\n';
+				++*failed;
+			}
+		}
+
+		// Start the longest jobs first, so the shortest ones fill in at the end.
+		std::stable_sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b)
+			{ return a.duration > b.duration; });
+
+		return jobs;
+	}
+
+
+	void acquire_memory(size_t memory)
+	{
+		std::unique_lock<std::mutex> lock{memory_mutex};
+		memory_released.wait(lock, [&]{ return memory_in_use == 0 ||
+			memory_in_use+memory <= LV::Constants::batch_memory_budget; });
+
+		memory_in_use += memory;
+	}
+
+
+	void release_memory(size_t memory)
+	{
+		{
+			std::lock_guard<std::mutex> lock{memory_mutex};
+			memory_in_use -= memory;
+		}
+
+		memory_released.notify_all();
+	}
+}
+
+
+// Generates and exports every supported audio file in the directory. Each job thread
+// takes the next file as soon as it finishes its last one, and every job shares the
+// thread pool for its DFTs, smoothing, and meshes, along with the FFT plans and the
+// caches.
+void LV::Batch::run(const GeneratorConfiguration& configuration,
+	const std::string& directory, const std::string& format, const std::string& orientation)
+{
+	LV::Exporter::validate_options(format, orientation);
+
+	// Find and plan the jobs.
+	const std::vector<std::string> file_names{find_audio_files(directory)};
+	if(file_names.empty()) throw std::runtime_error{"No supported audio files were found."};
+
+	std::cout<<"Found "<<file_names.size()<<" audio files.\n";
+
+	const LV::Generator planner{configuration};
+	std::atomic<int> failed{};
+	int planning_failures{};
+	const std::vector<Job> jobs{plan_jobs(planner, file_names, &planning_failures)};
+	failed += planning_failures;
+
+	// Run the jobs.
+	const auto start{std::chrono::steady_clock::now()};
+
+	std::atomic<size_t> next_job{};
+	std::atomic<int> completed{};
+	float completed_duration{};
+	memory_in_use = 0;
+
+	const auto run_jobs{[&]
+	{
+		while(true)
+		{
+			const size_t index{next_job++};
+			if(index >= jobs.size()) break;
+
+			const Job& job{jobs[index]};
+			acquire_memory(job.memory);
+
+			// Each job gets its own generator, so nothing it memoized outlives it.
+			try
+			{
+				LV::Generator generator{configuration};
+				LV::Exporter::export_model(&generator, job.file_name, format, orientation);
+
+				std::lock_guard<std::mutex> lock{output_mutex};
+				completed_duration += job.duration;
+				std::cout<<"Exported \""<<job.file_name<<"\" ("<<++completed<<"/"<<
+					jobs.size()<<").\n";
+			}
+			catch(std::exception& error)
+			{
+				std::lock_guard<std::mutex> lock{output_mutex};
+				std::cout<<"ERROR: "<<job.file_name<<": "<<error.what()<<'\n';
+				++failed;
+			}
+
+			release_memory(job.memory);
+		}
+	}};
+
+	const size_t thread_count{std::min<size_t>(
+		LV::ThreadPool::get_thread_count(), jobs.size())};
+
+	std::vector<std::thread> threads;
+	for(size_t index{1}; index < thread_count; ++index) threads.emplace_back(run_jobs);
+	if(thread_count > 0) run_jobs();
+	for(std::thread& thread : threads) thread.join();
+
+	// Print the summary.
+	const float minutes{std::chrono::duration<float>(
+		std::chrono::steady_clock::now()-start).count()/60.f};
+
+	std::cout<<"Batch finished: "<<completed<<" exported, "<<failed<<" failed, in "<<
+		minutes<<" minutes.\n";
+
+	if(minutes > 0.f) std::cout<<"Throughput: "<<completed/minutes<<" files/min, "<<
+		completed_duration/3600.f/minutes<<" audio-hours/min.\n";
+}
@@ -0,0 +1,23 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#pragma once
+
+#include <string>
+
+
+namespace LV
+{
+	struct GeneratorConfiguration;
+}
+
+
+namespace LV::Batch
+{
+	void run(const GeneratorConfiguration& configuration, const std::string& directory,
+		const std::string& format, const std::string& orientation);
+}
@@ -0,0 +1,338 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#include "Cache.hpp"
+
+#include <iostream>
+#include <filesystem>
+#include <cstring>
+#include <cstdio>
+#include <cstddef>
+#include <thread>
+
+#include "Constants.hpp"
+
+
+namespace
+{
+	constexpr char pcm_magic[8]{'L', 'V', 'P', 'C', 'M', 0, 0, 0};
+	constexpr uint32_t pcm_version{1};
+	constexpr size_t pcm_alignment{64}; // Bytes.
+	constexpr char spectrogram_magic[8]{'L', 'V', 'L', 'R', 'C', 0, 0, 0};
+	constexpr uint32_t spectrogram_version{1};
+
+	struct PCMHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t sample_rate;
+		uint64_t sample_count;
+		uint32_t key_size;
+		uint32_t data_offset;
+	};
+
+	// Followed by the key and then the values, compressed, without row padding.
+	struct SpectrogramHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t sample_rate;
+		uint64_t rows;
+		uint64_t columns;
+		float peak;
+		uint32_t key_size;
+		uint64_t compressed_size;
+	};
+
+
+	// Identifies the decoded samples of the audio file by its path, size, modification
+	// time, and the decoder settings.
+	std::string get_key(const std::string& audio_file, const std::string& decoder_settings)
+	{ return LV::Utilities::get_file_signature(audio_file)+"\n"+decoder_settings; }
+
+
+	// FNV-1a.
+	uint64_t hash(const std::string& string)
+	{
+		uint64_t result{14695981039346656037ull};
+
+		for(const char character : string)
+		{
+			result ^= static_cast<uint8_t>(character);
+			result *= 1099511628211ull;
+		}
+
+		return result;
+	}
+
+
+	std::string get_path(const std::string& key, const std::string& directory =
+		LV::Constants::pcm_cache_directory, const std::string& extension =
+		LV::Constants::pcm_cache_file_name_extension)
+	{
+		char name[17];
+		std::snprintf(name, sizeof(name), "%016llx",
+			static_cast<unsigned long long>(hash(key)));
+
+		return directory+name+extension;
+	}
+
+
+	std::string get_spectrogram_path(const std::string& key)
+	{
+		return get_path(key, LV::Constants::generated_data_directory,
+			LV::Constants::generated_data_file_name_extension);
+	}
+
+
+	// Each thread writes to its own temporary file, so generators on separate threads
+	// can cache the same file at once. The last to finish replaces the others' result.
+	std::string get_temporary_path(const std::string& path)
+	{
+		return path+"."+std::to_string(std::hash<std::thread::id>{}(
+			std::this_thread::get_id()))+".tmp";
+	}
+
+
+	size_t get_data_offset(size_t key_size)
+	{
+		const size_t size{sizeof(PCMHeader)+key_size};
+		return (size+pcm_alignment-1)/pcm_alignment*pcm_alignment;
+	}
+}
+
+
+// Maps the cached samples of the given audio file if they exist. Returns false if the
+// file has not been cached with the given decoder settings.
+bool LV::Cache::open_pcm(CachedPCM* pcm, const std::string& audio_file,
+	const std::string& decoder_settings)
+{
+	*pcm = {};
+
+	try
+	{
+		const std::string key{get_key(audio_file, decoder_settings)};
+		const std::string path{get_path(key)};
+		if(!std::filesystem::exists(path)) return false;
+
+		Utilities::map_file(&pcm->file, path);
+
+		// Validate the header.
+		PCMHeader header;
+		if(pcm->file.size < sizeof(header)){ close_pcm(pcm); return false; }
+		std::memcpy(&header, pcm->file.data, sizeof(header));
+
+		const bool valid{std::memcmp(header.magic, pcm_magic, sizeof(pcm_magic)) == 0 &&
+			header.version == pcm_version && header.key_size == key.size() &&
+			header.data_offset == get_data_offset(key.size()) &&
+			pcm->file.size == header.data_offset+header.sample_count*sizeof(float) &&
+			std::memcmp(pcm->file.data+sizeof(header), key.data(), key.size()) == 0};
+
+		if(!valid){ close_pcm(pcm); return false; }
+
+		pcm->samples = reinterpret_cast<const float*>(pcm->file.data+header.data_offset);
+		pcm->sample_count = static_cast<size_t>(header.sample_count);
+		pcm->sample_rate = static_cast<int>(header.sample_rate);
+		return true;
+	}
+	catch(std::exception&){ close_pcm(pcm); return false; }
+}
+
+
+void LV::Cache::close_pcm(CachedPCM* pcm)
+{
+	Utilities::unmap_file(&pcm->file);
+	*pcm = {};
+}
+
+
+// Starts caching the samples of the given audio file as they are decoded. Returns false
+// if the cache file could not be created, in which case decoding continues uncached.
+bool LV::Cache::begin_pcm(PCMCacheWriter* writer, const std::string& audio_file,
+	const std::string& decoder_settings, int sample_rate)
+{
+	try
+	{
+		const std::string key{get_key(audio_file, decoder_settings)};
+		writer->path = get_path(key);
+		writer->temporary_path = get_temporary_path(writer->path);
+		writer->sample_count = 0;
+
+		std::filesystem::create_directory(LV::Constants::pcm_cache_directory);
+		writer->stream.open(writer->temporary_path, std::ios::binary|std::ios::trunc);
+		if(!writer->stream) return false;
+
+		// Write the header. The sample count is filled in once decoding has finished.
+		PCMHeader header{};
+		std::memcpy(header.magic, pcm_magic, sizeof(pcm_magic));
+		header.version = pcm_version;
+		header.sample_rate = static_cast<uint32_t>(sample_rate);
+		header.key_size = static_cast<uint32_t>(key.size());
+		header.data_offset = static_cast<uint32_t>(get_data_offset(key.size()));
+
+		const std::string padding(header.data_offset-sizeof(header)-key.size(), '\0');
+		writer->stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		writer->stream.write(key.data(), key.size());
+		writer->stream.write(padding.data(), padding.size());
+
+		if(!writer->stream){ abandon_pcm(writer); return false; }
+		return true;
+	}
+	catch(std::exception&){ abandon_pcm(writer); return false; }
+}
+
+
+void LV::Cache::write_pcm(PCMCacheWriter* writer, const float* samples, size_t count)
+{
+	if(!writer->stream.is_open()) return;
+
+	writer->stream.write(reinterpret_cast<const char*>(samples), count*sizeof(float));
+	writer->sample_count += count;
+}
+
+
+// Completes the cache file and moves it into place.
+void LV::Cache::finish_pcm(PCMCacheWriter* writer)
+{
+	if(!writer->stream.is_open()) return;
+
+	const uint64_t sample_count{writer->sample_count};
+	writer->stream.seekp(offsetof(PCMHeader, sample_count));
+	writer->stream.write(reinterpret_cast<const char*>(&sample_count), sizeof(sample_count));
+	writer->stream.close();
+
+	if(!writer->stream){ abandon_pcm(writer); return; }
+
+	std::error_code error;
+	std::filesystem::rename(writer->temporary_path, writer->path, error);
+
+	if(error)
+	{
+		std::cout<<"WARNING: Could not save the decoded audio to the cache.\n";
+		abandon_pcm(writer);
+	}
+
+	writer->temporary_path.clear();
+}
+
+
+void LV::Cache::abandon_pcm(PCMCacheWriter* writer)
+{
+	if(writer->stream.is_open()) writer->stream.close();
+
+	std::error_code error;
+	if(!writer->temporary_path.empty())
+		std::filesystem::remove(writer->temporary_path, error);
+
+	writer->sample_count = 0;
+}
+
+
+// Loads the smoothed spectrogram saved with the given key if it exists. The key
+// describes the audio file and every setting the spectrogram depends on.
+bool LV::Cache::open_spectrogram(Spectrogram* spectrogram, float* peak,
+	int* sample_rate, const std::string& key)
+{
+	try
+	{
+		std::ifstream stream{get_spectrogram_path(key), std::ios::binary};
+		if(!stream) return false;
+
+		// Validate the header and key.
+		SpectrogramHeader header;
+		stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+		if(!stream || std::memcmp(header.magic, spectrogram_magic, sizeof(spectrogram_magic))
+			|| header.version != spectrogram_version || header.key_size != key.size())
+			return false;
+
+		std::string saved_key(header.key_size, '\0');
+		stream.read(saved_key.data(), saved_key.size());
+		if(!stream || saved_key != key) return false;
+
+		// Decompress the values.
+		std::vector<uint8_t> compressed(header.compressed_size);
+		stream.read(reinterpret_cast<char*>(compressed.data()), compressed.size());
+		if(!stream) return false;
+
+		const std::string values{Utilities::decompress(compressed)};
+		const size_t row_size{header.columns*sizeof(float)};
+		if(values.size() != header.rows*row_size) return false;
+
+		// Store the values in the spectrogram's own format.
+		spectrogram->reset(header.rows, header.columns);
+		for(size_t row{}; row < header.rows; ++row) spectrogram->store(row, 0, header.columns,
+			reinterpret_cast<const float*>(values.data()+row*row_size));
+
+		*peak = header.peak;
+		*sample_rate = static_cast<int>(header.sample_rate);
+		return true;
+	}
+	catch(std::exception&){ return false; }
+}
+
+
+void LV::Cache::save_spectrogram(const Spectrogram& spectrogram, float peak,
+	int sample_rate, const std::string& key)
+{
+	const std::string path{get_spectrogram_path(key)};
+	const std::string temporary_path{get_temporary_path(path)};
+
+	try
+	{
+		// Compress the values, always as floats, so that cached data does not depend on the
+		// storage format.
+		const size_t row_size{spectrogram.get_columns()*sizeof(float)};
+		std::string values(spectrogram.get_rows()*row_size, '\0');
+
+		for(size_t row{}; row < spectrogram.get_rows(); ++row)
+			spectrogram.load(row, 0, spectrogram.get_columns(),
+				reinterpret_cast<float*>(values.data()+row*row_size));
+
+		const std::vector<uint8_t> compressed{Utilities::compress(
+			values, Constants::generated_data_compression_level)};
+
+		// Write.
+		SpectrogramHeader header{};
+		std::memcpy(header.magic, spectrogram_magic, sizeof(spectrogram_magic));
+		header.version = spectrogram_version;
+		header.sample_rate = static_cast<uint32_t>(sample_rate);
+		header.rows = spectrogram.get_rows();
+		header.columns = spectrogram.get_columns();
+		header.peak = peak;
+		header.key_size = static_cast<uint32_t>(key.size());
+		header.compressed_size = compressed.size();
+
+		std::filesystem::create_directory(Constants::generated_data_directory);
+
+		{
+			std::ofstream stream{temporary_path, std::ios::binary|std::ios::trunc};
+			stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			stream.write(key.data(), key.size());
+			stream.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+			if(!stream) throw std::runtime_error{"Could not write the file."};
+		}
+
+		std::filesystem::rename(temporary_path, path);
+	}
+	catch(std::exception&)
+	{
+		std::cout<<"WARNING: Could not save the DFT data to the cache.\n";
+
+		std::error_code error;
+		std::filesystem::remove(temporary_path, error);
+	}
+}
+
+
+// Estimates the bytes 'save_spectrogram' allocates for a spectrogram with the given
+// number of values: a float copy of the values and the buffers used to compress it.
+size_t LV::Cache::estimate_save_memory(size_t value_count)
+{
+	const size_t values{value_count*sizeof(float)};
+	return values+Utilities::estimate_compression_memory(values);
+}
@@ -0,0 +1,62 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#pragma once
+
+#include <string>
+#include <fstream>
+
+#include "Utilities.hpp"
+#include "Spectrogram.hpp"
+
+
+namespace LV
+{
+	struct CachedPCM
+	{
+		MappedFile file;
+		const float* samples{nullptr};
+		size_t sample_count{};
+		int sample_rate{};
+	};
+
+	struct PCMCacheWriter
+	{
+		std::ofstream stream;
+		std::string path;
+		std::string temporary_path;
+		size_t sample_count{};
+	};
+}
+
+
+namespace LV::Cache
+{
+	// Decoded PCM.
+	bool open_pcm(CachedPCM* pcm, const std::string& audio_file,
+		const std::string& decoder_settings);
+
+	void close_pcm(CachedPCM* pcm);
+
+	bool begin_pcm(PCMCacheWriter* writer, const std::string& audio_file,
+		const std::string& decoder_settings, int sample_rate);
+
+	void write_pcm(PCMCacheWriter* writer, const float* samples, size_t count);
+
+	void finish_pcm(PCMCacheWriter* writer);
+
+	void abandon_pcm(PCMCacheWriter* writer);
+
+	// Smoothed spectrograms.
+	bool open_spectrogram(Spectrogram* spectrogram, float* peak,
+		int* sample_rate, const std::string& key);
+
+	void save_spectrogram(const Spectrogram& spectrogram, float peak,
+		int sample_rate, const std::string& key);
+
+	size_t estimate_save_memory(size_t value_count);
+}
@@ -23,7 +23,12 @@ namespace LV::Constants
 	// Generator.
 	const std::string generated_data_directory{"Configurations/"};
 	const std::string generated_data_file_name_extension{".lrc"};
+	constexpr int generated_data_compression_level{3};
+	const std::string pcm_cache_directory{"Cache/"};
+	const std::string pcm_cache_file_name_extension{".pcm"};
+	const std::string fftw_wisdom_path{"Configurations/FFTW Wisdom.txt"};
 	constexpr int dft_noise_floor{90}; // Decibels.
+	constexpr float quantized_decibel_range{256.f}; // Decibels.
 	constexpr float bottom{-50.f};
 
 	// Viewer.
@@ -43,4 +48,13 @@ namespace LV::Constants
 	const std::vector<std::string> supported_formats{"ply", "obj", "stl"};
 	const std::string material_name{"Material"};
 	constexpr glm::fvec3 material_color{.5f, .5f, .5f};
+
+	// Batch.
+	const std::vector<std::string> supported_audio_formats{"flac", "wav", "mp3"};
+	constexpr size_t batch_memory_budget{size_t{4} << 30}; // Bytes.
+
+	// Server.
+	const std::string default_socket_path{"resonance.sock"};
+	constexpr size_t maximum_request_size{1 << 16}; // Bytes.
+	constexpr size_t server_cache_budget{size_t{4} << 30}; // Bytes of idle generators.
 }
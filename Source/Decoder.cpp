@@ -8,7 +8,22 @@
 #include "Decoder.hpp"
 
 #include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <thread>
+#include <cstring>
+#include <limits>
+#include <type_traits>
 #include <cmath>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 extern "C"
 {
@@ -18,211 +33,860 @@ extern "C"
 	#include <libavutil/opt.h>
 }
 
+#include "Utilities.hpp"
+
 
 namespace
 {
 	constexpr int channel_count{1};
 	constexpr AVSampleFormat sample_format{AV_SAMPLE_FMT_FLTP};
+	constexpr int resampler_precision{33};
+	constexpr float stereo_gain{.70710678f}; // Matches the resampler's default downmix.
+	constexpr float seek_margin{.1f}; // Seconds.
+	constexpr float segment_duration{8.f}; // Seconds.
+	constexpr unsigned maximum_segment_threads{16};
+	constexpr int io_buffer_size{65536}; // Bytes.
+
+	// The input's bytes and this context's read position within them.
+	struct MemoryReader
+	{
+		const uint8_t* data;
+		size_t size;
+		size_t position;
+	};
+
+	// The FFmpeg state for decoding one file, released when the context is destroyed.
+	struct Context
+	{
+		Context(const uint8_t* input, size_t input_size,
+			const std::string& name, unsigned draft_sample_rate);
+
+		~Context();
+
+		Context(const Context&) = delete;
+		Context& operator=(const Context&) = delete;
+
+		MemoryReader reader{};
+		AVIOContext* io_context{nullptr};
+		AVFormatContext* format_context{nullptr};
+		AVCodec* codec{nullptr};
+		AVCodecContext* codec_context{nullptr};
+		struct SwrContext* resampler_context{nullptr};
+		AVFrame* frame{nullptr};
+		AVPacket packet{};
+		uint64_t channel_layout{};
+
+		int stream_index{};
+		uint64_t clipped_samples{};
+		float peak{};
+		unsigned original_channel_count{};
+		unsigned original_sample_rate{};
+		unsigned original_bit_depth{};
+
+		// The rate of the decoded samples, and whether they are downmixed directly from
+		// the decoded frames instead of going through the resampler.
+		unsigned output_sample_rate{};
+		bool direct{};
+
+		// Decoded samples waiting to be read. The vector doubles as the resample buffer,
+		// so it only grows until it can hold the largest packet and is reused from then on.
+		std::vector<float> data;
+		size_t data_size{};
+		size_t data_offset{};
+		bool end_of_file{};
+
+		// The index of the next resampled sample, and the range of samples to keep. A
+		// range end of -1 keeps everything until the end of the file.
+		int64_t position{};
+		int64_t range_start{};
+		int64_t range_end{-1};
+	};
+
+
+	// Clamps the samples to [-1, 1] in place and updates the peak, returning the number of
+	// samples that were out of range. Every path orders its comparisons like the SSE
+	// min and max, so NaN samples are clipped to -1 and left out of the peak wherever
+	// they fall.
+	uint64_t clip_samples(float* samples, size_t count, float* peak)
+	{
+		size_t index{};
+		uint64_t clipped{};
+		float local_peak{*peak};
+
+		#if defined(__x86_64__) || defined(_M_X64)
+		const __m128 sign_mask{_mm_set1_ps(-0.f)};
+		const __m128 one{_mm_set1_ps(1.f)};
+		const __m128 negative_one{_mm_set1_ps(-1.f)};
+		__m128 peaks{_mm_set1_ps(local_peak)};
+		__m128i clipped_counts{_mm_setzero_si128()};
+
+		for(; index+4 <= count; index += 4)
+		{
+			const __m128 sample{_mm_loadu_ps(samples+index)};
+			const __m128 magnitude{_mm_andnot_ps(sign_mask, sample)};
+			peaks = _mm_max_ps(magnitude, peaks);
+
+			// Comparison masks are all ones (-1) in each lane that is out of range.
+			clipped_counts = _mm_sub_epi32(clipped_counts,
+				_mm_castps_si128(_mm_cmpgt_ps(magnitude, one)));
+
+			_mm_storeu_ps(samples+index, _mm_min_ps(_mm_max_ps(sample, negative_one), one));
+		}
+
+		alignas(16) float peak_lanes[4];
+		alignas(16) uint32_t clipped_lanes[4];
+		_mm_store_ps(peak_lanes, peaks);
+		_mm_store_si128(reinterpret_cast<__m128i*>(clipped_lanes), clipped_counts);
+
+		for(int lane{}; lane < 4; ++lane)
+		{
+			local_peak = std::max(local_peak, peak_lanes[lane]);
+			clipped += clipped_lanes[lane];
+		}
+
+		#elif defined(__ARM_NEON)
+		const float32x4_t one{vdupq_n_f32(1.f)};
+		const float32x4_t negative_one{vdupq_n_f32(-1.f)};
+		float32x4_t peaks{vdupq_n_f32(local_peak)};
+		uint32x4_t clipped_counts{vdupq_n_u32(0)};
+
+		for(; index+4 <= count; index += 4)
+		{
+			const float32x4_t sample{vld1q_f32(samples+index)};
+			const float32x4_t magnitude{vabsq_f32(sample)};
+			peaks = vbslq_f32(vcgtq_f32(magnitude, peaks), magnitude, peaks);
+			clipped_counts = vsubq_u32(clipped_counts, vcgtq_f32(magnitude, one));
+
+			// NEON's min and max propagate NaN, so select on the comparisons instead.
+			const float32x4_t raised{vbslq_f32(vcgtq_f32(sample, negative_one),
+				sample, negative_one)};
+
+			vst1q_f32(samples+index, vbslq_f32(vcltq_f32(raised, one), raised, one));
+		}
+
+		// Reduce the lanes pairwise, which 32-bit ARM also supports.
+		const float32x2_t peak_pairs{vpmax_f32(vget_low_f32(peaks), vget_high_f32(peaks))};
+		const uint32x2_t clipped_pairs{vpadd_u32(
+			vget_low_u32(clipped_counts), vget_high_u32(clipped_counts))};
+
+		local_peak = std::max(local_peak,
+			vget_lane_f32(vpmax_f32(peak_pairs, peak_pairs), 0));
+		clipped += vget_lane_u32(vpadd_u32(clipped_pairs, clipped_pairs), 0);
+		#endif
+
+		// Process the remaining samples.
+		for(; index < count; ++index)
+		{
+			const float magnitude{std::abs(samples[index])};
+			local_peak = std::max(local_peak, magnitude);
+			clipped += magnitude > 1.f;
+			const float raised{samples[index] > -1.f ? samples[index] : -1.f};
+			samples[index] = raised < 1.f ? raised : 1.f;
+		}
+
+		*peak = local_peak;
+		return clipped;
+	}
+
+
+	// Converts the frame's samples to mono floats, as the resampler would.
+	template<typename T>
+	void downmix(const AVFrame* frame, bool planar, int channels, float* output)
+	{
+		constexpr float scale{std::is_same_v<T, float> ? 1.f :
+			1.f/(static_cast<float>(std::numeric_limits<T>::max())+1.f)};
 
-	AVFormatContext* format_context;
-	AVCodec* codec;
-	AVCodecContext* codec_context;
-	struct SwrContext* resampler_context;
-	AVFrame* frame;
-	AVPacket packet;
-	float** resample_buffer;
-	uint64_t channel_layout;
+		const int count{frame->nb_samples};
+		const T* left{reinterpret_cast<const T*>(frame->extended_data[0])};
 
-	int stream_index;
-	uint64_t clipped_samples;
-	float peak;
-	unsigned original_channel_count;
-	unsigned original_sample_rate;
-	unsigned original_bit_depth;
+		if(channels == 1)
+			for(int index{}; index < count; ++index) output[index] = left[index]*scale;
+
+		else if(planar)
+		{
+			const T* right{reinterpret_cast<const T*>(frame->extended_data[1])};
+
+			for(int index{}; index < count; ++index) output[index] = (static_cast<float>(
+				left[index])+static_cast<float>(right[index]))*(scale*stereo_gain);
+		}
+
+		else for(int index{}; index < count; ++index) output[index] = (static_cast<float>(
+			left[index*2])+static_cast<float>(left[index*2+1]))*(scale*stereo_gain);
+	}
 
-	std::vector<float> data;
+
+	// Returns whether the frames can be downmixed directly instead of being resampled.
+	bool supports_direct_downmix(const Context& context)
+	{
+		if(context.output_sample_rate != context.original_sample_rate) return false;
+		if(context.original_channel_count < 1 || context.original_channel_count > 2) return false;
+
+		switch(context.codec_context->sample_fmt)
+		{
+			case AV_SAMPLE_FMT_FLT: case AV_SAMPLE_FMT_FLTP:
+			case AV_SAMPLE_FMT_S16: case AV_SAMPLE_FMT_S16P:
+			case AV_SAMPLE_FMT_S32: case AV_SAMPLE_FMT_S32P: return true;
+			default: return false;
+		}
+	}
+
+
+	void downmix(const Context& context, float* output)
+	{
+		const int channels{static_cast<int>(context.original_channel_count)};
+
+		switch(context.codec_context->sample_fmt)
+		{
+			case AV_SAMPLE_FMT_FLT: downmix<float>(context.frame, false, channels, output); break;
+			case AV_SAMPLE_FMT_FLTP: downmix<float>(context.frame, true, channels, output); break;
+			case AV_SAMPLE_FMT_S16: downmix<int16_t>(context.frame, false, channels, output); break;
+			case AV_SAMPLE_FMT_S16P: downmix<int16_t>(context.frame, true, channels, output); break;
+			case AV_SAMPLE_FMT_S32: downmix<int32_t>(context.frame, false, channels, output); break;
+			case AV_SAMPLE_FMT_S32P: downmix<int32_t>(context.frame, true, channels, output); break;
+			default: throw std::runtime_error{"Could not downmix a frame."};
+		}
+	}
 
 
 	// Processes and saves the decoded frames to the data vector.
-	int process_decoded_frames()
+	int process_decoded_frames(Context* context)
 	{
 		while(true)
 		{
 			// Retrieve a frame from the decoder.
-			int error{avcodec_receive_frame(codec_context, frame)};
+			int error{avcodec_receive_frame(context->codec_context, context->frame)};
 			if(error < 0) return error;
 
-			// Allocate the resample buffer.
-			int buffer_size{swr_get_out_samples(resampler_context, frame->nb_samples)};
+			// Locate the frame within the track. The resampler holds back some samples,
+			// so its output starts that far before the frame.
+			const AVStream* stream{context->format_context->streams[context->stream_index]};
+			const int output_sample_rate{static_cast<int>(context->output_sample_rate)};
+
+			if(context->frame->best_effort_timestamp != AV_NOPTS_VALUE)
+			{
+				const int64_t start_time{stream->start_time != AV_NOPTS_VALUE ?
+					stream->start_time : 0};
+
+				context->position = av_rescale_q(context->frame->best_effort_timestamp-
+					start_time, stream->time_base, {1, output_sample_rate});
+
+				if(!context->direct) context->position -=
+					swr_get_delay(context->resampler_context, output_sample_rate);
+			}
+
+			// Make room for the frame after the samples already in the buffer.
+			const int buffer_size{context->direct ? context->frame->nb_samples :
+				swr_get_out_samples(context->resampler_context, context->frame->nb_samples)};
+
+			if(buffer_size < 0) throw std::runtime_error{"Could not resample a frame."};
+
+			if(context->data.size() < context->data_size+buffer_size)
+				context->data.resize(context->data_size+buffer_size);
+
+			float* samples{context->data.data()+context->data_size};
+			int samples_written{buffer_size};
+
+			// Downmix or resample the frame directly into the buffer.
+			if(context->direct) downmix(*context, samples);
 
-			if(av_samples_alloc_array_and_samples(
-				reinterpret_cast<uint8_t***>(&resample_buffer), nullptr,
-				channel_count, buffer_size, sample_format, 0) < 0)
-				throw std::runtime_error{"Could not allocate a resample buffer."};
+			else
+			{
+				uint8_t* output{reinterpret_cast<uint8_t*>(samples)};
+
+				samples_written = swr_convert(context->resampler_context, &output, buffer_size,
+					const_cast<const uint8_t**>(context->frame->extended_data),
+					context->frame->nb_samples);
+
+				if(samples_written < 0) throw std::runtime_error{"Could not resample a frame."};
+			}
 
-			// Resample the frame.
-			int samples_written{swr_convert(resampler_context,
-				reinterpret_cast<uint8_t**>(resample_buffer), buffer_size,
-				const_cast<const uint8_t**>(frame->extended_data), frame->nb_samples)};
+			const int64_t frame_start{context->position};
+			context->position += samples_written;
 
-			if(samples_written < 0) throw std::runtime_error{"Could not resample a frame."};
+			// Drop the samples outside of the range.
+			const int64_t first{std::clamp<int64_t>(
+				context->range_start-frame_start, 0, samples_written)};
 
-			// For each processed sample...
-			peak = 0;
-			for(int j{}; j < samples_written; ++j)
+			int64_t last{samples_written};
+
+			if(context->range_end >= 0)
 			{
-				// Make sure the sample is in range.
-				float sample{resample_buffer[0][j]};
-				float absolute_value_sample{std::abs(sample)};
-				if(absolute_value_sample > peak) peak = absolute_value_sample;
-				if(sample > 1){ ++clipped_samples; sample = 1; }
-				if(sample < -1){ ++clipped_samples; sample = -1; }
-
-				// Store the sample.
-				data.emplace_back(sample);
+				last = std::clamp<int64_t>(context->range_end-frame_start, 0, samples_written);
+				if(context->position >= context->range_end) context->end_of_file = true;
 			}
 
-			// Destroy.
-			av_freep(&resample_buffer[0]);
-			av_freep(&resample_buffer);
-			av_frame_unref(frame);
+			const int kept{static_cast<int>(std::max<int64_t>(last-first, 0))};
+			if(first > 0 && kept > 0) std::copy_n(samples+first, kept, samples);
+
+			// Make sure the samples are in range.
+			context->clipped_samples += clip_samples(samples, kept, &context->peak);
+			context->data_size += kept;
+
+			av_frame_unref(context->frame);
 		}
 	}
 
 
 	// Decodes the recieved audio packet.
-	void decode_packet()
+	void decode_packet(Context* context)
 	{
 		// If the packet is not from the desired stream, destroy it and return.
-		if(packet.stream_index != stream_index)
+		if(context->packet.stream_index != context->stream_index)
 		{
-			av_packet_unref(&packet);
+			av_packet_unref(&context->packet);
 			return;
 		}
 
 		// Otherwise, send the packet to the decoder.
-		if(avcodec_send_packet(codec_context, &packet))
+		if(avcodec_send_packet(context->codec_context, &context->packet))
 			throw std::runtime_error{"Could not send a packet to the decoder."};
 
-		av_packet_unref(&packet);
+		av_packet_unref(&context->packet);
 
 		// Retrieve and process the decoded frames.
-		if(process_decoded_frames() != AVERROR(EAGAIN))
+		if(process_decoded_frames(context) != AVERROR(EAGAIN))
 			throw std::runtime_error{"Could not process a decoded frame."};
 	}
+
+
+	int read_memory(void* opaque, uint8_t* buffer, int size)
+	{
+		MemoryReader* reader{static_cast<MemoryReader*>(opaque)};
+		const size_t count{std::min(static_cast<size_t>(size), reader->size-reader->position)};
+		if(count == 0) return AVERROR_EOF;
+
+		std::memcpy(buffer, reader->data+reader->position, count);
+		reader->position += count;
+		return static_cast<int>(count);
+	}
+
+
+	int64_t seek_memory(void* opaque, int64_t offset, int whence)
+	{
+		MemoryReader* reader{static_cast<MemoryReader*>(opaque)};
+		if(whence & AVSEEK_SIZE) return static_cast<int64_t>(reader->size);
+
+		int64_t position;
+		switch(whence & ~AVSEEK_FORCE)
+		{
+			case SEEK_SET: position = offset; break;
+			case SEEK_CUR: position = static_cast<int64_t>(reader->position)+offset; break;
+			case SEEK_END: position = static_cast<int64_t>(reader->size)+offset; break;
+			default: return AVERROR(EINVAL);
+		}
+
+		if(position < 0 || position > static_cast<int64_t>(reader->size))
+			return AVERROR(EINVAL);
+
+		reader->position = static_cast<size_t>(position);
+		return position;
+	}
+
+
+	// Loads the information from the given audio file's bytes, which FFmpeg reads
+	// through a custom I/O context instead of its own file I/O.
+	void open(Context* context, const uint8_t* input, size_t input_size,
+		const std::string& name)
+	{
+		av_log_set_level(AV_LOG_QUIET);
+
+		// Create the I/O context.
+		context->reader = {input, input_size, 0};
+
+		uint8_t* io_buffer{static_cast<uint8_t*>(av_malloc(io_buffer_size))};
+		if(!io_buffer) throw std::runtime_error{"Could not allocate the I/O buffer."};
+
+		context->io_context = avio_alloc_context(io_buffer, io_buffer_size, 0,
+			&context->reader, read_memory, nullptr, seek_memory);
+
+		if(!context->io_context)
+		{
+			av_free(io_buffer);
+			throw std::runtime_error{"Could not allocate the I/O context."};
+		}
+
+		// Allocate the format context.
+		context->format_context = avformat_alloc_context();
+		if(!context->format_context)
+			throw std::runtime_error{"Could not allocate the format context."};
+
+		context->format_context->pb = context->io_context;
+		context->format_context->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+		// Open the file. On failure, FFmpeg frees the format context.
+		if(avformat_open_input(&context->format_context, name.c_str(), nullptr, nullptr))
+			throw std::runtime_error{"Could not open the file \""+name+"\"."};
+
+		// Retrieve the file's stream information.
+		if(avformat_find_stream_info(context->format_context, nullptr) < 0)
+			throw std::runtime_error{"Could not retrieve the stream information."};
+
+		// Find the audio stream and codec.
+		context->stream_index = av_find_best_stream(context->format_context,
+			AVMEDIA_TYPE_AUDIO, -1, -1, &context->codec, NULL);
+
+		if(context->stream_index < 0)
+			throw std::runtime_error{"Could not find a supported audio stream."};
+
+		AVStream *stream{context->format_context->streams[context->stream_index]};
+
+		// Initialize the codec context.
+		context->codec_context = avcodec_alloc_context3(context->codec);
+		if(!context->codec_context)
+			throw std::runtime_error{"Could not initialize the codec context."};
+
+		// Fill the codec context with the parameters of the stream's codec.
+		if(avcodec_parameters_to_context(context->codec_context, stream->codecpar) < 0)
+			throw std::runtime_error{"Could not set the codec context's parameters."};
+
+		// Retrieve the channel count, sample rate, and bit depth.
+		AVCodecContext* codec_context{context->codec_context};
+		context->original_channel_count = static_cast<unsigned>(codec_context->channels);
+		context->original_sample_rate = static_cast<unsigned>(codec_context->sample_rate);
+		context->original_bit_depth = static_cast<unsigned>(
+			codec_context->bits_per_raw_sample);
+
+		// Determine the channel layout.
+		context->channel_layout = codec_context->channel_layout;
+		if(!context->channel_layout) context->channel_layout = static_cast<uint64_t>(
+			av_get_default_channel_layout(codec_context->channels));
+	}
+
+
+	void initialize_resampler(Context* context)
+	{
+		context->resampler_context = swr_alloc_set_opts(nullptr, AV_CH_LAYOUT_MONO,
+			sample_format, context->output_sample_rate, context->channel_layout,
+			context->codec_context->sample_fmt, context->original_sample_rate, 0, nullptr);
+
+		SwrContext* resampler_context{context->resampler_context};
+		if(!resampler_context) throw std::runtime_error{"Could not allocate the resampler."};
+
+		if(av_opt_set_int(resampler_context, "resampler", SWR_ENGINE_SOXR, NULL))
+			throw std::runtime_error{"Could not enable the SOX resampler."};
+
+		if(av_opt_set_int(resampler_context, "precision", resampler_precision, NULL))
+			throw std::runtime_error{"Could not set the SOX resampler precision."};
+
+		if(av_opt_set_int(resampler_context, "cheby", 1, NULL))
+			throw std::runtime_error{"Could not enable Chebyshev passband rolloff."};
+
+		if(av_opt_set_int(resampler_context, "dither_method", SWR_DITHER_NS_SHIBATA, NULL))
+			throw std::runtime_error{"Could not enable Shibata noise shaping dithering."};
+
+		swr_init(resampler_context);
+		if(!swr_is_initialized(resampler_context))
+			throw std::runtime_error{"Could not initialize the resampler."};
+	}
+
+
+	// Initializes the resampler and decoder with the given settings. The resampler is
+	// only used if the samples need to be resampled or are in an uncommon format.
+	void initialize(Context* context, unsigned draft_sample_rate)
+	{
+		context->output_sample_rate = context->original_sample_rate;
+		if(draft_sample_rate > 0) context->output_sample_rate =
+			std::min(context->output_sample_rate, draft_sample_rate);
+
+		context->direct = supports_direct_downmix(*context);
+		if(!context->direct) initialize_resampler(context);
+
+		// Initialize the decoder.
+		if(avcodec_open2(context->codec_context, context->codec, nullptr) < 0)
+			throw std::runtime_error{"Could not initialize the decoder."};
+
+		// Create the frame.
+		context->frame = av_frame_alloc();
+		if(!context->frame) throw std::runtime_error{"Could not create the frame."};
+
+		// Initialize the packet.
+		av_init_packet(&context->packet);
+
+		// Size the decoded sample buffer for a full frame if the codec has a fixed frame
+		// size.
+		const int frame_size{context->codec_context->frame_size};
+		if(frame_size > 0) context->data.resize(static_cast<size_t>(context->direct ?
+			frame_size : swr_get_out_samples(context->resampler_context, frame_size)));
+	}
+
+
+	// Restricts decoding to the given range of samples. Seeking lands a short margin
+	// before the start so the resampler has settled by the first kept sample, and
+	// everything decoded before the start is dropped using the frame timestamps. If
+	// seeking is not possible the decoder simply reads from the beginning.
+	void seek(Context* context, int64_t start, int64_t end)
+	{
+		context->range_start = start;
+		context->range_end = end;
+		context->data_size = 0;
+		context->data_offset = 0;
+		context->end_of_file = false;
+
+		const int64_t margin{static_cast<int64_t>(
+			seek_margin*context->output_sample_rate)};
+
+		const int64_t target{std::max<int64_t>(start-margin, 0)};
+		if(target == 0 && context->position == 0) return;
+
+		const AVStream* stream{context->format_context->streams[context->stream_index]};
+		const int64_t start_time{stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0};
+
+		const int64_t timestamp{start_time+av_rescale_q(target,
+			{1, static_cast<int>(context->output_sample_rate)}, stream->time_base)};
+
+		if(av_seek_frame(context->format_context, context->stream_index,
+			timestamp, AVSEEK_FLAG_BACKWARD) < 0) return;
+
+		// Discard the decoder's and resampler's state from before the seek.
+		avcodec_flush_buffers(context->codec_context);
+		if(!context->direct) swr_init(context->resampler_context);
+		context->position = target;
+	}
+
+
+	// Writes up to the given number of samples to the destination, decoding packets as
+	// needed. Returns the number of samples written, which is only less than the
+	// requested count once the end of the range has been reached.
+	size_t read(Context* context, float* destination, size_t count)
+	{
+		size_t written{};
+
+		while(written < count)
+		{
+			// Copy any samples left over from the previously decoded packet.
+			if(context->data_offset < context->data_size)
+			{
+				const size_t copied{std::min(count-written,
+					context->data_size-context->data_offset)};
+
+				std::copy_n(context->data.begin()+context->data_offset,
+					copied, destination+written);
+
+				context->data_offset += copied;
+				written += copied;
+				continue;
+			}
+
+			// Otherwise, decode the next packet.
+			if(context->end_of_file) break;
+
+			context->data_size = 0;
+			context->data_offset = 0;
+
+			if(av_read_frame(context->format_context, &context->packet) < 0)
+				context->end_of_file = true;
+
+			else decode_packet(context);
+		}
+
+		return written;
+	}
+
+
+	// Deallocates any resources.
+	void close(Context* context)
+	{
+		av_packet_unref(&context->packet);
+		if(context->frame) av_frame_free(&context->frame);
+		if(context->resampler_context) swr_free(&context->resampler_context);
+
+		if(context->codec_context)
+		{
+			avcodec_close(context->codec_context);
+			avcodec_free_context(&context->codec_context);
+		}
+
+		if(context->format_context) avformat_close_input(&context->format_context);
+
+		// Custom I/O contexts are not freed with the format context.
+		if(context->io_context)
+		{
+			av_freep(&context->io_context->buffer);
+			avio_context_free(&context->io_context);
+		}
+	}
+
+
+	Context::Context(const uint8_t* input, size_t input_size,
+		const std::string& name, unsigned draft_sample_rate)
+	{
+		try
+		{
+			open(this, input, input_size, name);
+			initialize(this, draft_sample_rate);
+		}
+		catch(...){ close(this); throw; }
+	}
+
+
+	Context::~Context(){ close(this); }
+
+
+	// Only containers that seek to exact samples can be split into segments.
+	bool supports_segmentation(const Context& context)
+	{
+		const char* name{context.format_context->iformat->name};
+		const bool seekable{context.format_context->pb && context.format_context->pb->seekable};
+
+		return seekable && context.format_context->duration > 0 &&
+			(std::strcmp(name, "wav") == 0 || std::strcmp(name, "flac") == 0);
+	}
+}
+
+
+// Splits the track into segments that are decoded concurrently, each by its own context,
+// and returned in order.
+struct LV::DecoderState
+{
+	// The input's bytes, which are shared by every context. If the input is a file,
+	// these are mapped from it.
+	MappedFile mapped_file;
+	const uint8_t* input;
+	size_t input_size;
+	std::string name;
+
+	unsigned draft_sample_rate;
+	std::unique_ptr<Context> primary;
+	int64_t requested_start{};
+	int64_t requested_end{-1};
+
+	bool segmented{false};
+	unsigned thread_count{};
+	int64_t segment_size{};
+	int64_t next_segment_start{};
+	int64_t segmented_end{};
+
+	std::mutex mutex;
+	std::vector<std::unique_ptr<Context>> idle_contexts;
+	std::deque<std::future<std::vector<float>>> segments;
+
+	std::vector<float> current_segment;
+	size_t current_segment_offset{};
+};
+
+
+namespace
+{
+	std::vector<float> decode_segment(LV::DecoderState* state, int64_t start, int64_t end)
+	{
+		// Take an idle context, or open a new one.
+		std::unique_ptr<Context> context;
+
+		{
+			std::lock_guard<std::mutex> lock{state->mutex};
+			if(!state->idle_contexts.empty())
+			{
+				context = std::move(state->idle_contexts.back());
+				state->idle_contexts.pop_back();
+			}
+		}
+
+		if(!context) context = std::make_unique<Context>(state->input,
+			state->input_size, state->name, state->draft_sample_rate);
+
+		// Decode the segment. If this fails, the context is discarded.
+		std::vector<float> samples(static_cast<size_t>(end-start));
+		seek(context.get(), start, end);
+		samples.resize(read(context.get(), samples.data(), samples.size()));
+
+		// Return the context.
+		std::lock_guard<std::mutex> lock{state->mutex};
+		state->idle_contexts.emplace_back(std::move(context));
+		return samples;
+	}
+
+
+	// Keeps two segments per thread in flight, so the next set is decoding while the
+	// previous one is being read.
+	void queue_segments(LV::DecoderState* state)
+	{
+		while(state->segments.size() < state->thread_count*2 &&
+			state->next_segment_start < state->segmented_end)
+		{
+			const int64_t start{state->next_segment_start};
+			const int64_t end{std::min(start+state->segment_size, state->segmented_end)};
+			state->next_segment_start = end;
+
+			state->segments.emplace_back(std::async(
+				std::launch::async, decode_segment, state, start, end));
+		}
+	}
+
+
+	size_t read_segments(LV::DecoderState* state, float* destination, size_t count)
+	{
+		size_t written{};
+
+		while(written < count)
+		{
+			// Copy from the current segment.
+			if(state->current_segment_offset < state->current_segment.size())
+			{
+				const size_t copied{std::min(count-written,
+					state->current_segment.size()-state->current_segment_offset)};
+
+				std::copy_n(state->current_segment.begin()+state->current_segment_offset,
+					copied, destination+written);
+
+				state->current_segment_offset += copied;
+				written += copied;
+				continue;
+			}
+
+			// Otherwise, wait for the next segment.
+			queue_segments(state);
+			if(state->segments.empty()) break;
+
+			state->current_segment = state->segments.front().get();
+			state->current_segment_offset = 0;
+			state->segments.pop_front();
+		}
+
+		return written;
+	}
 }
 
 
-// Loads the information from the given audio file.
-void LV::Decoder::load_track_information(const std::string& file)
+// Opens the given audio file, which is memory-mapped and read in place. If a draft
+// sample rate is given, tracks with a higher sample rate are downsampled to it for
+// faster, lower fidelity generation.
+LV::Decoder::Decoder(const std::string& file, unsigned draft_sample_rate) :
+	state{std::make_unique<DecoderState>()}
 {
-	av_log_set_level(AV_LOG_QUIET);
-
-	// Allocate the format context.
-	format_context = avformat_alloc_context();
-	if(!format_context) throw std::runtime_error{"Could not allocate the format context."};
-
-	// Open the file.
-	if(avformat_open_input(&format_context, file.c_str(), nullptr, nullptr))
-		throw std::runtime_error{"Could not open the file \""+file+"\"."};
-
-	// Retrieve the file's stream information.
-	if(avformat_find_stream_info(format_context, nullptr) < 0)
-		throw std::runtime_error{"Could not retrieve the stream information."};
-
-	// Find the audio stream and codec.
-	stream_index = av_find_best_stream(format_context,
-		AVMEDIA_TYPE_AUDIO, -1, -1, &codec, NULL);
-	if(stream_index < 0) throw std::runtime_error{"Could not find a supported audio stream."};
-	AVStream *stream{format_context->streams[stream_index]};
-
-	// Initialize the codec context.
-	codec_context = avcodec_alloc_context3(codec);
-	if(!codec_context) throw std::runtime_error{"Could not initialize the codec context."};
-
-	// Fill the codec context with the parameters of the stream's codec.
-	if(avcodec_parameters_to_context(codec_context, stream->codecpar) < 0)
-		throw std::runtime_error{"Could not set the codec context's parameters."};
-
-	// Retrieve the channel count, sample rate, and bit depth.
-	original_channel_count = static_cast<unsigned>(codec_context->channels);
-	original_sample_rate = static_cast<unsigned>(codec_context->sample_rate);
-	original_bit_depth = static_cast<unsigned>(codec_context->bits_per_raw_sample);
-
-	// Determine the channel layout.
-	channel_layout = codec_context->channel_layout;
-	if(!channel_layout) channel_layout = static_cast<uint64_t>(
-		av_get_default_channel_layout(codec_context->channels));
+	Utilities::map_file(&state->mapped_file, file);
+
+	try{ open(state->mapped_file.data, state->mapped_file.size, file, draft_sample_rate); }
+	catch(...){ Utilities::unmap_file(&state->mapped_file); throw; }
 }
 
 
-// Initializes the resampler and decoder with the given settings.
-void LV::Decoder::initialize_resampler_and_decoder()
+// Opens audio file bytes already in memory. The bytes must remain valid for the lifetime
+// of the decoder. The name is only used to help identify the format and in errors.
+LV::Decoder::Decoder(const uint8_t* data, size_t size,
+	const std::string& name, unsigned draft_sample_rate) :
+	state{std::make_unique<DecoderState>()}
+{ open(data, size, name, draft_sample_rate); }
+
+
+LV::Decoder::~Decoder()
 {
-	// Initialize the resampler.
-	resampler_context = swr_alloc_set_opts(nullptr, AV_CH_LAYOUT_MONO,
-		sample_format, original_sample_rate, channel_layout,
-		codec_context->sample_fmt, original_sample_rate, 0, nullptr);
+	// Wait for the segments in flight, then destroy the contexts before unmapping the
+	// input they read from.
+	for(std::future<std::vector<float>>& segment : state->segments)
+		if(segment.valid()) segment.wait();
+
+	state->segments.clear();
+	state->idle_contexts.clear();
+	state->primary.reset();
+	Utilities::unmap_file(&state->mapped_file);
+}
 
-	if(av_opt_set_int(resampler_context, "resampler", SWR_ENGINE_SOXR, NULL))
-		throw std::runtime_error{"Could not enable the SOX resampler."};
 
-	if(av_opt_set_int(resampler_context, "precision", 33, NULL))
-		throw std::runtime_error{"Could not set the SOX resampler precision."};
+void LV::Decoder::open(const uint8_t* data, size_t size,
+	const std::string& name, unsigned draft_sample_rate)
+{
+	state->input = data;
+	state->input_size = size;
+	state->name = name;
+	state->draft_sample_rate = draft_sample_rate;
+	state->primary = std::make_unique<Context>(data, size, name, draft_sample_rate);
+}
 
-	if(av_opt_set_int(resampler_context, "cheby", 1, NULL))
-		throw std::runtime_error{"Could not enable Chebyshev passband rolloff."};
 
-	if(av_opt_set_int(resampler_context, "dither_method", SWR_DITHER_NS_SHIBATA, NULL))
-		throw std::runtime_error{"Could not enable Shibata noise shaping dithering."};
+// Restricts decoding to the given range in seconds. An end of zero or less decodes until
+// the end of the file. For containers that seek accurately, the range is split into
+// segments decoded on multiple threads.
+void LV::Decoder::set_range(float start, float end)
+{
+	Context* primary{state->primary.get()};
+	const unsigned sample_rate{primary->output_sample_rate};
+	const int64_t range_start{std::llround(std::max(start, 0.f)*sample_rate)};
+	const int64_t range_end{end > 0.f ? std::llround(end*sample_rate) : -1};
+
+	state->requested_start = range_start;
+	state->requested_end = range_end;
 
-	swr_init(resampler_context);
-	if(!swr_is_initialized(resampler_context))
-		throw std::runtime_error{"Could not initialize the resampler."};
+	// Decode segments in parallel if it is worthwhile.
+	const unsigned thread_count{std::min(std::max(
+		std::thread::hardware_concurrency(), 1u), maximum_segment_threads)};
 
-	// Initialize the decoder.
-	if(avcodec_open2(codec_context, codec, nullptr) < 0)
-		throw std::runtime_error{"Could not initialize the decoder."};
+	const int64_t segment_size{static_cast<int64_t>(segment_duration*sample_rate)};
 
-	// Create the frame.
-	frame = av_frame_alloc();
-	if(!frame) throw std::runtime_error{"Could not create the frame."};
+	const int64_t track_end{av_rescale(primary->format_context->duration,
+		sample_rate, AV_TIME_BASE)};
 
-	// Initialize the packet.
-	av_init_packet(&packet);
-	if(!&packet) throw std::runtime_error{"Could not initialize the packet."};
+	const int64_t segmented_end{range_end >= 0 ? std::min(range_end, track_end) : track_end};
 
-	// Allocate the channels.
-	data.resize(channel_count);
+	if(thread_count > 1 && supports_segmentation(*primary) &&
+		segmented_end-range_start > segment_size)
+	{
+		state->segmented = true;
+		state->thread_count = thread_count;
+		state->segment_size = segment_size;
+		state->next_segment_start = range_start;
+		state->segmented_end = segmented_end;
+		state->current_segment_offset = 0;
+
+		// The track's duration is only an estimate, so unless the range ends before it,
+		// the primary context decodes anything that turns out to be past it.
+		if(range_end < 0 || range_end > track_end) seek(primary, segmented_end, range_end);
+		else primary->end_of_file = true;
+	}
+
+	else seek(primary, range_start, range_end);
 }
 
 
-// Loads the entire audio file into the data vector.
-void LV::Decoder::load_samples()
+// Writes up to the given number of samples to the destination, decoding as needed.
+// Returns the number of samples written, which is only less than the requested count
+// once the end of the range has been reached.
+size_t LV::Decoder::read_samples(float* destination, size_t count)
 {
-	// Read packets until there are none left.
-	while(av_read_frame(format_context, &packet) != AVERROR_EOF) decode_packet();
+	if(!state->segmented) return read(state->primary.get(), destination, count);
+
+	// Read the segments, followed by anything past the estimated duration.
+	size_t written{read_segments(state.get(), destination, count)};
+
+	if(written < count && state->segments.empty())
+		written += read(state->primary.get(), destination+written, count-written);
+
+	return written;
 }
 
 
-// Resets values and deallocates any resources.
-void LV::Decoder::destroy()
+int LV::Decoder::get_sample_rate() const
+{ return static_cast<int>(state->primary->output_sample_rate); }
+
+
+size_t LV::Decoder::get_estimated_sample_count() const
 {
-	data.clear();
+	const Context& primary{*state->primary};
+	if(primary.format_context->duration <= 0) return 0;
 
-	if(resample_buffer && resample_buffer[0]) av_freep(&resample_buffer[0]);
-	if(resample_buffer) av_freep(&resample_buffer);
+	int64_t sample_count{av_rescale(primary.format_context->duration,
+		primary.output_sample_rate, AV_TIME_BASE)};
 
-	if(&packet) av_packet_unref(&packet);
-	if(frame) av_frame_free(&frame);
+	if(state->requested_end >= 0)
+		sample_count = std::min(sample_count, state->requested_end);
 
-	if(resampler_context) swr_free(&resampler_context);
-	if(codec_context){ avcodec_close(codec_context); avcodec_free_context(&codec_context); }
-	if(format_context) avformat_close_input(&format_context);
-	if(format_context) avformat_free_context(format_context);
+	return static_cast<size_t>(std::max<int64_t>(sample_count-state->requested_start, 0));
 }
 
 
-const std::vector<float>& LV::Decoder::get_data(){ return data; }
+// Returns the file's bits per second, or zero if neither the container nor the codec
+// records it.
+int64_t LV::Decoder::get_bit_rate() const
+{
+	const Context& primary{*state->primary};
+	if(primary.format_context->bit_rate > 0) return primary.format_context->bit_rate;
+	return std::max<int64_t>(primary.codec_context->bit_rate, 0);
+}
+
 
-const int LV::Decoder::get_sample_rate(){ return original_sample_rate; }
+// Describes everything that affects the decoded samples besides the file itself.
+std::string LV::Decoder::get_settings(unsigned draft_sample_rate)
+{
+	return "draft "+std::to_string(draft_sample_rate)+", direct mono and stereo downmix, "
+		"otherwise soxr precision "+std::to_string(resampler_precision)+
+		", chebyshev, shibata dithering, mono float, clipped";
+}
\ No newline at end of file
@@ -8,22 +8,45 @@
 #pragma once
 
 #include <string>
-#include <vector>
+#include <memory>
+#include <cstdint>
 
 
-namespace LV::Decoder
+namespace LV
 {
-	void load_track_information(const std::string& file);
+	struct DecoderState;
 
-	void initialize_resampler_and_decoder();
+	class Decoder
+	{
+	public:
+		explicit Decoder(const std::string& file, unsigned draft_sample_rate = 0);
 
-	void load_samples();
+		Decoder(const uint8_t* data, size_t size,
+			const std::string& name, unsigned draft_sample_rate = 0);
 
-	void destroy();
+		~Decoder();
 
+		Decoder(const Decoder&) = delete;
+		Decoder& operator=(const Decoder&) = delete;
 
-	// Getters.
-	const std::vector<float>& get_data();
+		void set_range(float start, float end);
 
-	const int get_sample_rate();
+		size_t read_samples(float* destination, size_t count);
+
+
+		// Getters.
+		int get_sample_rate() const;
+
+		size_t get_estimated_sample_count() const;
+
+		int64_t get_bit_rate() const;
+
+		static std::string get_settings(unsigned draft_sample_rate);
+
+	private:
+		std::unique_ptr<DecoderState> state;
+
+		void open(const uint8_t* data, size_t size,
+			const std::string& name, unsigned draft_sample_rate);
+	};
 }
\ No newline at end of file
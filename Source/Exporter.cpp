@@ -9,6 +9,8 @@
 
 #include <iostream>
 #include <filesystem>
+#include <memory>
+#include <algorithm>
 #include <assimp/Exporter.hpp>
 #include <assimp/scene.h>
 
@@ -19,18 +21,11 @@
 
 namespace
 {
-	std::string format;
-	std::string file_name;
-	bool z_up;
+	constexpr size_t allocation_overhead{16}; // Bytes per heap allocation.
 
-	glm::fvec2 dft_size;
-	LV::Mesh dft_mesh;
-	LV::Mesh base_mesh;
-	aiScene* scene;
 
-
-	void populate_scene_mesh(unsigned scene_mesh_index,
-		const std::string& mesh_name, const LV::Mesh& dft_mesh)
+	void populate_scene_mesh(aiScene* scene, unsigned scene_mesh_index,
+		const std::string& mesh_name, const LV::Mesh& dft_mesh, bool z_up)
 	{
 		// Populate the vertices.
 		aiMesh* mesh{scene->mMeshes[scene_mesh_index]};
@@ -70,12 +65,13 @@ namespace
 	}
 
 
-	void generate_scene()
+	std::unique_ptr<aiScene> generate_scene(const LV::Mesh& dft_mesh,
+		const LV::Mesh& base_mesh, bool z_up)
 	{
 		std::cout<<"Generating the export data...\n";
 
 		// Create the scene and root node.
-		scene = new aiScene();
+		std::unique_ptr<aiScene> scene{std::make_unique<aiScene>()};
 		scene->mRootNode = new aiNode();
 
 		// Create the material.
@@ -98,8 +94,8 @@ namespace
 			scene->mMeshes[index] = new aiMesh;
 			scene->mMeshes[index]->mMaterialIndex = 0;
 
-			if(index == 0) populate_scene_mesh(index, "DFT", dft_mesh);
-			else if(index == 1) populate_scene_mesh(index, "Base", base_mesh);
+			if(index == 0) populate_scene_mesh(scene.get(), index, "DFT", dft_mesh, z_up);
+			else if(index == 1) populate_scene_mesh(scene.get(), index, "Base", base_mesh, z_up);
 		}
 
 		// Link the meshes to the root node.
@@ -107,52 +103,70 @@ namespace
 		scene->mRootNode->mMeshes = new unsigned int[scene->mRootNode->mNumMeshes];
 		for(unsigned index{}; index < scene->mRootNode->mNumMeshes; ++index)
 			scene->mRootNode->mMeshes[index] = index;
+
+		return scene;
 	}
 
 	
-	void export_scene()
+	// Exports the scene to the exports directory, named after the audio file without
+	// its directory and followed by the suffix.
+	void export_scene(const aiScene& scene, const std::string& file_name,
+		const std::string& format, const std::string& name_suffix)
 	{
 		std::cout<<"Exporting...\n";
-		std::filesystem::create_directory(LV::Constants::exports_directory);
+		std::filesystem::create_directories(LV::Constants::exports_directory);
 
-		std::string name{file_name};
+		std::string name{std::filesystem::path{file_name}.filename().string()+name_suffix};
 		std::replace(name.begin(), name.end(), '.', '-');
 
 		Assimp::Exporter exporter;
-		if(exporter.Export(scene, format, LV::Constants::exports_directory+name+
+		if(exporter.Export(&scene, format, LV::Constants::exports_directory+name+
 			"."+format) != AI_SUCCESS) throw std::runtime_error{"Export failed."};
 	}
 }
 
 
-void LV::Exporter::export_model(const std::string& file_name,
-	const std::string& format, const std::string& orientation)
+// Generates the meshes with the given generator and exports them. Only the generator
+// is shared between calls, so exports using separate generators can run on separate
+// threads.
+void LV::Exporter::export_model(Generator* generator,
+	const std::string& file_name, const std::string& format,
+	const std::string& orientation, float start, float end,
+	const std::string& name_suffix)
 {
-	::file_name = file_name;
-	::format = format;
-
-	// Validate the format.
-	if(!LV::Utilities::is_supported(format, LV::Constants::supported_formats))
-		throw std::runtime_error{"Unrecognized export format."};
-
-	// Parse the Y-Up variable.
-	if(orientation == "z-up") z_up = true;
-	else if(orientation == "y-up") z_up = false;
-	else throw std::runtime_error{"'orientation' must be either 'z-up' or 'y-up'."};
+	// Validate.
+	validate_options(format, orientation);
+	const bool z_up{orientation == "z-up"};
 	
 	// Generate the meshes.
-	LV::Generator::generate(file_name);
-	dft_size = LV::Generator::get_size();
-	dft_mesh = LV::Generator::get_dft_mesh();
-	base_mesh = LV::Generator::get_base_mesh();
+	generator->generate(file_name, start, end);
 
 	// Generate the Assimp scene.
-	generate_scene();
+	const std::unique_ptr<aiScene> scene{generate_scene(
+		generator->get_dft_mesh(), generator->get_base_mesh(), z_up)};
 
 	// Export the Assimp scene as the given format.
-	export_scene();
+	export_scene(*scene, file_name, format, name_suffix);
 	std::cout<<"Export finished.\n";
+}
+
 
-	// Destroy the scene.
-	delete scene;
+void LV::Exporter::validate_options(const std::string& format,
+	const std::string& orientation)
+{
+	if(!LV::Utilities::is_supported(format, LV::Constants::supported_formats))
+		throw std::runtime_error{"Unrecognized export format."};
+
+	if(orientation != "z-up" && orientation != "y-up")
+		throw std::runtime_error{"'orientation' must be either 'z-up' or 'y-up'."};
+}
+
+
+// Estimates the bytes of the Assimp scene built for a DFT mesh with the given number of
+// vertices. The scene copies each vertex and allocates each triangle's indices
+// separately, about two triangles per vertex.
+size_t LV::Exporter::estimate_memory(size_t vertex_count)
+{
+	const size_t face_size{sizeof(aiFace)+3*sizeof(unsigned)+allocation_overhead};
+	return vertex_count*(sizeof(aiVector3D)+2*face_size);
 }
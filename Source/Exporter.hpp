@@ -10,8 +10,20 @@
 #include <string>
 
 
+namespace LV
+{
+	class Generator;
+}
+
+
 namespace LV::Exporter
 {
-	void export_model(const std::string& file_name,
-		const std::string& format, const std::string& orientation);
+	void export_model(Generator* generator,
+		const std::string& file_name, const std::string& format,
+		const std::string& orientation, float start = 0.f, float end = 0.f,
+		const std::string& name_suffix = {});
+
+	void validate_options(const std::string& format, const std::string& orientation);
+
+	size_t estimate_memory(size_t vertex_count);
 }
\ No newline at end of file
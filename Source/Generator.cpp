@@ -11,392 +11,762 @@
 #include <fstream>
 #include <sstream>
 #include <filesystem>
-#include <complex>
-#include <thread>
+#include <algorithm>
 #include <glm/gtc/reciprocal.hpp>
-#include <glm/gtx/transform.hpp>
-#include <fftw/fftw3.h>
 
 #include "Constants.hpp"
 #include "Utilities.hpp"
 #include "Decoder.hpp"
+#include "STFT.hpp"
+#include "Cache.hpp"
+#include "Spectrogram.hpp"
+#include "Smoothing.hpp"
+#include "ThreadPool.hpp"
 
 
 namespace
 {
-	float dft_window_duration{30.f}; // Milliseconds.
-	float dft_sample_interval{1.f}; // Milliseconds.
-	int harmonic_smoothing{15}; // Frequencies.
-	int temporal_smoothing{0}; // DFTs.
-	float height_multiplier{.33f};
-	bool logarithmic{false};
+	constexpr size_t maximum_memoized_samples{1 << 26}; // About 25 minutes at 44.1 kHz.
+	constexpr size_t mesh_row_grain_size{16}; // DFTs per task.
+	constexpr size_t preview_point_count{1 << 18};
+	constexpr int maximum_pyramid_level{8};
 
-	glm::ivec2 size;
-	float height;
-	glm::fmat4 center_matrix;
-
-	std::vector<float> audio_data;
-	int sample_rate;
-	std::vector<std::vector<float>> dft_data;
-	float dft_peak;
-	LV::Mesh dft_mesh;
-	LV::Mesh base_mesh;
 
+	void generate_square_indicies(unsigned* indicies, unsigned top_left,
+		unsigned bottom_left, unsigned bottom_right, unsigned top_right)
+	{
+		// Bottom left triangle.
+		indicies[0] = top_left;
+		indicies[1] = bottom_left;
+		indicies[2] = bottom_right;
 
-	void add_vertex(LV::Mesh* mesh, const glm::fvec3& vertex)
-	{ mesh->vertices.emplace_back(center_matrix*glm::fvec4{vertex, 1.f}); }
+		// Top right triangle.
+		indicies[3] = bottom_right;
+		indicies[4] = top_right;
+		indicies[5] = top_left;
+	}
 
 
 	void generate_square_indicies(std::vector<unsigned>* indicies, unsigned top_left,
 		unsigned bottom_left, unsigned bottom_right, unsigned top_right)
 	{
-		// Bottom left triangle.
-		indicies->emplace_back(top_left);
-		indicies->emplace_back(bottom_left);
-		indicies->emplace_back(bottom_right);
+		indicies->resize(indicies->size()+6);
+		generate_square_indicies(indicies->data()+indicies->size()-6,
+			top_left, bottom_left, bottom_right, top_right);
+	}
 
-		// Top right triangle.
-		indicies->emplace_back(bottom_right);
-		indicies->emplace_back(top_right);
-		indicies->emplace_back(top_left);
+
+	const std::string window_error{"The DFT window duration is greater than the "
+		"duration of the loaded audio file. Decrease the DFT window duration or load a "
+		"longer audio file."};
+
+	const std::string interval_error{"The DFT sample interval will result in less "
+		"than 2 generated DFTs. Decrease the DFT sample interval or load a longer audio "
+		"file."};
+
+	const std::string harmonic_smoothing_error{"The harmonic smoothing value will be "
+		"greater than the number of frequencies generated by the set DFT window duration. "
+		"Decrease the harmonic smoothing value or increase the DFT window duration."};
+
+	const std::string temporal_smoothing_error{"The temporal smoothing value will be "
+		"greater than the number of generated DFTs. Decrease the temporal smoothing "
+		"value or the DFT sample interval, or load a longer audio file."};
+
+
+	// Returns the level of the pyramid with at most the preview number of values.
+	int get_preview_level(size_t rows, size_t columns)
+	{
+		int level{};
+		while(level < maximum_pyramid_level &&
+			(rows >> level)*(columns >> level) > preview_point_count) ++level;
+
+		return level;
 	}
 
 
-	void load_audio_data(const std::string& file_name)
+	void nonnegative_validation(float x, const std::string& name)
+	{
+		if(x < 0) throw std::runtime_error{"The "+name+" value cannot be negative."};
+	}
+
+
+	void minmax_validation(float x, float minimum, float maximum, const std::string& name)
+	{
+		if(x <= minimum) throw std::runtime_error{
+			"The "+name+" value must be above "+std::to_string(minimum)+"."};
+
+		if(x > maximum) throw std::runtime_error{
+			"The "+name+" value must be below "+std::to_string(maximum)+"."};
+	}
+
+
+	void validate_generation(const std::string& file_name, float start, float end)
+	{
+		nonnegative_validation(start, "start time");
+		nonnegative_validation(end, "end time");
+
+		if(end > 0.f && end <= start)
+			throw std::runtime_error{"The end time must be after the start time."};
+
+		if(!std::filesystem::exists(file_name))
+			throw std::runtime_error{"Could not open the file \""+file_name+"\"."};
+	}
+}
+
+
+void LV::Generator::check_cancellation() const
+{
+	if(cancellation && *cancellation)
+		throw std::runtime_error{"The generation was cancelled."};
+}
+
+
+glm::fvec3 LV::Generator::center(const glm::fvec3& vertex) const
+{ return vertex*center_scale+center_offset; }
+
+
+void LV::Generator::add_vertex(LV::Mesh* mesh, const glm::fvec3& vertex)
+{ mesh->vertices.emplace_back(center(vertex)); }
+
+
+// Reads the samples memoized by the last generation if they match, maps the decoded
+// samples from the cache if they exist, and otherwise opens the audio file for
+// decoding. Only complete tracks are saved to the cache, so decoding an excerpt never
+// costs more than the excerpt itself. Samples read from the cache or decoder are
+// memoized as they are read.
+void LV::Generator::open_audio_data(const std::string& file_name, float start, float end,
+	const std::string& key)
+{
+	audio_open = true;
+	audio_memoized = key == audio_key;
+
+	if(audio_memoized)
+	{
+		sample_rate = audio_sample_rate;
+		audio_position = 0;
+		audio_end = audio_samples.size();
+		estimated_sample_count = audio_end;
+		return;
+	}
+
+	audio_key.clear();
+	pending_audio_key = key;
+	audio_samples.clear();
+
+	const unsigned draft_sample_rate{static_cast<unsigned>(configuration.draft_sample_rate)};
+	const std::string decoder_settings{LV::Decoder::get_settings(draft_sample_rate)};
+
+	if(LV::Cache::open_pcm(&cached_pcm, file_name, decoder_settings))
+	{
+		std::cout<<"Loading the cached audio data...\n";
+		sample_rate = cached_pcm.sample_rate;
+
+		const auto get_index{[&](float time)
+		{ return std::min(static_cast<size_t>(time*sample_rate), cached_pcm.sample_count); }};
+
+		audio_position = get_index(start);
+		audio_end = end > 0.f ? get_index(end) : cached_pcm.sample_count;
+		audio_end = std::max(audio_end, audio_position);
+		estimated_sample_count = audio_end-audio_position;
+	}
+
+	else
 	{
 		std::cout<<"Loading the audio data...\n";
 
-		// Get the audio data.
-		LV::Decoder::load_track_information(file_name);
-		LV::Decoder::initialize_resampler_and_decoder();
-		LV::Decoder::load_samples();
-		audio_data = LV::Decoder::get_data();
-		sample_rate = LV::Decoder::get_sample_rate();
-		LV::Decoder::destroy();
+		decoder = std::make_unique<LV::Decoder>(file_name, draft_sample_rate);
+		decoder->set_range(start, end);
+
+		sample_rate = decoder->get_sample_rate();
+		estimated_sample_count = decoder->get_estimated_sample_count();
+
+		if(start <= 0.f && end <= 0.f) LV::Cache::begin_pcm(&pcm_cache_writer,
+			file_name, decoder_settings, sample_rate);
 	}
 
+	if(estimated_sample_count <= maximum_memoized_samples)
+		audio_samples.reserve(estimated_sample_count);
+}
 
-	float get_hann_multiplier(int x, int maximum)
-	{ return .5f*(1.f-std::cos(2.f*3.1415926f*x/(maximum))); }
 
+void LV::Generator::memoize_audio_data(const float* samples, size_t count)
+{
+	if(pending_audio_key.empty()) return;
 
-	std::vector<std::vector<float>> smoothing_iteration(
-		std::vector<std::vector<float>>* input, int samples, bool harmonic)
+	// Give up on memoizing audio too long to keep in memory.
+	if(audio_samples.size()+count > maximum_memoized_samples)
 	{
-		std::vector<std::vector<float>> result;
-		dft_peak = 0.f;
+		pending_audio_key.clear();
+		audio_samples.clear();
+		audio_samples.shrink_to_fit();
+		return;
+	}
 
-		// For each DFT...
-		for(int dft_index{}; dft_index < input->size(); ++dft_index)
-		{
-			result.emplace_back();
+	audio_samples.insert(audio_samples.end(), samples, samples+count);
+}
 
-			// For each frequency...
-			for(int frequency_index{}; frequency_index <
-				(*input)[dft_index].size(); ++frequency_index)
-			{
-				float decibels{};
-
-				// If no averaging is desired, use the frequency directly,
-				if(samples == 0) decibels = (*input)[dft_index][frequency_index];
-
-				// Otherwise, average the surrounding frequencies.
-				else
-				{
-					int divisor{1};
-
-					for(int offset{-samples}; offset <= samples; ++offset)
-					{
-						// Harmonically sample, applying a Hann window.
-						if(harmonic)
-						{
-							const int sample_index{frequency_index+offset};
-							if(sample_index < 0 || sample_index > (*input)[0].size()-1) continue;
-							decibels += (*input)[dft_index][sample_index];
-						}
-
-						// Temporally sample, applying a Hann window.
-						else
-						{
-							const int sample_index{dft_index+offset};
-							if(sample_index < 0 || sample_index > input->size()-1) continue;
-							decibels += (*input)[sample_index][frequency_index];
-						}
-
-						++divisor;
-					}
-
-					decibels /= divisor;
-				}
-
-				// Get the peak and emplace back.
-				dft_peak = std::max(dft_peak, decibels);
-				result.back().emplace_back(decibels);
-			}
-		}
 
-		input->clear();
-		input->shrink_to_fit();
-		return result;
+size_t LV::Generator::read_audio_data(float* destination, size_t count)
+{
+	check_cancellation();
+
+	// Copy from the memoized samples.
+	if(audio_memoized)
+	{
+		const size_t read{std::min(count, audio_end-audio_position)};
+		std::copy_n(audio_samples.data()+audio_position, read, destination);
+		audio_position += read;
+		return read;
+	}
+
+	// Copy from the cache.
+	if(cached_pcm.samples)
+	{
+		const size_t read{std::min(count, audio_end-audio_position)};
+		std::copy_n(cached_pcm.samples+audio_position, read, destination);
+		audio_position += read;
+		memoize_audio_data(destination, read);
+		return read;
 	}
 
+	// Otherwise, decode and save to the cache.
+	const size_t read{decoder->read_samples(destination, count)};
+	LV::Cache::write_pcm(&pcm_cache_writer, destination, read);
+	memoize_audio_data(destination, read);
+	return read;
+}
+
 
-	void generate_dft_data()
+void LV::Generator::close_audio_data(bool completed)
+{
+	audio_open = false;
+	if(audio_memoized) return;
+
+	if(completed)
 	{
-		// Initialize.
-		const int dft_window_size{static_cast<int>(
-			sample_rate*(dft_window_duration/1000.f))};
+		audio_key = pending_audio_key;
+		audio_sample_rate = sample_rate;
+	}
 
-		const int maximum_frequency{dft_window_size/2-1};
+	else audio_samples.clear();
+	pending_audio_key.clear();
 
-		const int dft_sample_interval_size{static_cast<int>(
-			sample_rate*(dft_sample_interval/1000.f))};
+	if(cached_pcm.samples) LV::Cache::close_pcm(&cached_pcm);
 
-		const size_t generated_dft_count{audio_data.size()/dft_sample_interval_size};
+	else
+	{
+		decoder.reset();
 
-		height = dft_window_size/2.f*height_multiplier;
+		if(completed) LV::Cache::finish_pcm(&pcm_cache_writer);
+		else LV::Cache::abandon_pcm(&pcm_cache_writer);
+	}
+}
 
-		// Validate.
-		if(dft_window_size > audio_data.size()) throw std::runtime_error{"The DFT window "
-			"duration is greater than the duration of the loaded audio file. Decrease the "
-			"DFT window duration or load a longer audio file."};
 
-		if(dft_sample_interval_size+dft_window_size > audio_data.size())
-			throw std::runtime_error{"The DFT sample interval will result in less than 2 "
-			"generated DFTs. Decrease the DFT sample interval or load a longer audio file."};
+// Returns the STFT settings for the configuration at the given sample rate.
+LV::STFT::Settings LV::Generator::get_stft_settings(int sample_rate) const
+{
+	const int dft_window_size{static_cast<int>(
+		sample_rate*(configuration.dft_window_duration/1000.f))};
 
-		if(harmonic_smoothing > maximum_frequency) throw std::runtime_error{"The harmonic "
-			"smoothing value will be greater than the number of frequencies generated by the "
-			"set DFT window duration. Decrease the harmonic smoothing value or increase the "
-			"DFT window duration."};
+	const int dft_sample_interval_size{static_cast<int>(
+		sample_rate*(configuration.dft_sample_interval/1000.f))};
 
-		if(temporal_smoothing > generated_dft_count) throw std::runtime_error{"The temporal "
-			"smoothing value will be greater than the number of generated DFTs. Decrease the "
-			"temporal smoothing value or the DFT sample interval, or load a longer audio "
-			"file."};
+	return {dft_window_size, dft_sample_interval_size,
+		configuration.zero_padding ? LV::STFT::get_fast_size(dft_window_size) : 0,
+		configuration.band_count, configuration.band_scale, sample_rate};
+}
 
-		// Warnings.
-		const size_t generated_point_count{generated_dft_count*maximum_frequency};
 
-		if(generated_dft_count*maximum_frequency > 10000000) std::cout<<"WARNING: "+
-			std::to_string(generated_point_count)+" data points will be generated with this "
-			"configuration. This may cause performance issues. You may want to increase the "
-			"DFT sample interval, decrease the DFT window size, or load a shorter audio "
-			"file.\n";
+// Zero padding to a fast transform size interpolates between the frequencies without
+// extending their range, and banding merges them. The mesh spacing and harmonic
+// smoothing are scaled to match, so the model keeps its proportions.
+void LV::Generator::update_frequency_spacing()
+{
+	const LV::STFT::Settings stft_settings{get_stft_settings(sample_rate)};
+	const int transform_size{LV::STFT::get_transform_size(stft_settings)};
 
-		const size_t sampled_point_count{generated_point_count*
-			(harmonic_smoothing+temporal_smoothing)*2};
+	frequency_spacing = stft_settings.window_size/static_cast<float>(transform_size)*
+		(transform_size/2-1)/static_cast<float>(
+		std::max(LV::STFT::get_column_count(stft_settings), 1));
+}
 
-		if(sampled_point_count > 1000000000) std::cout<<"WARNING: "+std::to_string(
-			sampled_point_count)+" data points will be sampled with this configuration. This "
-			"may cause performance issues. You may want to decrease the harmonic or temporal "
-			"smoothing, increase the DFT sample interval, decrease the DFT window size, or "
-			"load a shorter audio file.\n";
 
-		// Run a fast Fourier transform.
-		std::cout<<"Generating the DFT data...\n";
-		fftwf_init_threads();
+int LV::Generator::get_scaled_harmonic_smoothing() const
+{
+	return static_cast<int>(std::round(
+		configuration.harmonic_smoothing/frequency_spacing));
+}
 
-		std::vector<float> input(dft_window_size);
-		std::vector<std::complex<float>> output(dft_window_size);
 
-		fftwf_plan_with_nthreads(std::thread::hardware_concurrency());
-		fftwf_plan plan{fftwf_plan_dft_r2c_1d(dft_window_size, input.data(),
-			reinterpret_cast<fftwf_complex*>(output.data()), FFTW_MEASURE)};
+// Discards the spectrogram's contents and sets it to the selected storage format.
+void LV::Generator::set_storage_format(LV::Spectrogram* spectrogram)
+{
+	spectrogram->set_format(configuration.storage_format,
+		LV::Constants::quantized_decibel_range/65535.f);
+}
 
-		uint64_t offset{};
-		std::vector<std::vector<float>> raw_dft_data;
 
-		while(offset+dft_window_size < audio_data.size())
-		{
-			// Fill the input buffer, applying a Hann window.
-			for(int index{}; index < dft_window_size; ++index)
-			{
-				const float hann_multiplier{get_hann_multiplier(index, dft_window_size)};
-				input[index] = hann_multiplier*audio_data[offset+index];
-			}
+void LV::Generator::generate_raw_dft_data()
+{
+	// Initialize.
+	const LV::STFT::Settings stft_settings{get_stft_settings(sample_rate)};
+	const int column_count{LV::STFT::get_column_count(stft_settings)};
+	update_frequency_spacing();
+
+	// The raw DFT data may be shared with other generators, so it is replaced rather
+	// than overwritten.
+	raw_dft_data.reset();
+	const std::shared_ptr<LV::Spectrogram> data{std::make_shared<LV::Spectrogram>()};
+	set_storage_format(data.get());
+
+	// Validate. The audio is streamed into the DFT, so the checks that depend on its
+	// length use the estimated length here and are repeated with the actual number
+	// of generated DFTs afterwards.
+	if(get_scaled_harmonic_smoothing() > column_count)
+		throw std::runtime_error{harmonic_smoothing_error};
+
+	if(stft_settings.hop_size < 1) throw std::runtime_error{"The DFT sample "
+		"interval is shorter than one sample. Increase the DFT sample interval."};
+
+	size_t generated_dft_count{};
+	if(estimated_sample_count > 0)
+	{
+		generated_dft_count = estimated_sample_count/stft_settings.hop_size;
 
-			// Execute the fast Fourier transform.
-			fftwf_execute(plan);
+		if(stft_settings.window_size > estimated_sample_count)
+			throw std::runtime_error{window_error};
 
-			raw_dft_data.emplace_back();
-			for(int index{}; index < maximum_frequency; ++index)
-			{
-				// Convert the complex DFT data to decibels.
-				std::complex<float> complex_value{output[index]};
+		if(stft_settings.hop_size+stft_settings.window_size > estimated_sample_count)
+			throw std::runtime_error{interval_error};
 
-				const float magnitude{std::sqrtf(std::powf(complex_value.real(), 2)+
-					std::powf(complex_value.imag(), 2))};
+		if(configuration.temporal_smoothing > generated_dft_count)
+			throw std::runtime_error{temporal_smoothing_error};
+	}
 
-				float decibels{20.f*std::log10(magnitude)};
-				decibels += LV::Constants::dft_noise_floor;
-				if(decibels < 0) decibels = 0;
+	// Warnings.
+	const size_t generated_point_count{generated_dft_count*column_count};
 
-				// Save the data.
-				raw_dft_data.back().emplace_back(decibels);
-			}
+	if(generated_point_count > 10000000) std::cout<<"WARNING: "+
+		std::to_string(generated_point_count)+" data points will be generated with this "
+		"configuration. This may cause performance issues. You may want to increase the "
+		"DFT sample interval, decrease the DFT window size, or load a shorter audio "
+		"file.\n";
 
-			offset += dft_sample_interval_size;
-		}
+	// Stream the audio into a short-time Fourier transform.
+	std::cout<<"Generating the DFT data...\n";
 
-		// Apply harmonic smoothing.
-		std::vector<std::vector<float>> harmonically_smoothed_dft_data{
-			smoothing_iteration(&raw_dft_data, harmonic_smoothing, true)};
+	LV::STFT::transform([this](float* destination, size_t count)
+		{ return read_audio_data(destination, count); },
+		stft_settings, data.get(), estimated_sample_count);
 
-		// Apply temporal smoothing.
-		dft_data = smoothing_iteration(&harmonically_smoothed_dft_data,
-			temporal_smoothing, false);
+	close_audio_data(true);
 
-		size = {dft_data[0].size(), dft_data.size()};
+	// Validate the actual number of generated DFTs.
+	if(data->empty()) throw std::runtime_error{window_error};
+	if(data->get_rows() < 2) throw std::runtime_error{interval_error};
 
-		// Apply normalization and height scaling.
-		for(int dft_index{}; dft_index < dft_data.size(); ++dft_index)
-			for(int frequency_index{}; frequency_index <
-				dft_data[dft_index].size(); ++frequency_index)
-			{
-				float* value{&dft_data[dft_index][frequency_index]};
-				*value = std::min(std::max(*value/dft_peak, 0.f), 1.f)*height;
-			}
+	raw_dft_data = data;
+}
+
+
+void LV::Generator::generate_harmonic_dft_data()
+{
+	// Validate.
+	const int scaled_harmonic_smoothing{get_scaled_harmonic_smoothing()};
+
+	if(scaled_harmonic_smoothing > raw_dft_data->get_columns())
+		throw std::runtime_error{harmonic_smoothing_error};
+
+	if(scaled_harmonic_smoothing <= 0)
+	{
+		harmonic_dft_data = raw_dft_data;
+		return;
+	}
+
+	// Apply harmonic smoothing.
+	std::cout<<"Smoothing the DFT data harmonically...\n";
+	const std::shared_ptr<Spectrogram> data{std::make_shared<Spectrogram>(*raw_dft_data)};
+	check_cancellation();
+
+	LV::Smoothing::smooth_harmonics(data.get(),
+		scaled_harmonic_smoothing, configuration.smoothing_kernel);
+
+	harmonic_dft_data = data;
+}
+
+
+void LV::Generator::generate_smoothed_dft_data()
+{
+	// Validate.
+	if(configuration.temporal_smoothing > harmonic_dft_data->get_rows())
+		throw std::runtime_error{temporal_smoothing_error};
+
+	// Apply temporal smoothing.
+	std::cout<<"Smoothing the DFT data temporally...\n";
+	smoothed_dft_data = *harmonic_dft_data;
+	check_cancellation();
 
-		// Destroy.
-		fftwf_destroy_plan(plan);
-		fftwf_cleanup_threads();
+	smoothed_dft_peak = LV::Smoothing::smooth_temporally(&smoothed_dft_data,
+		configuration.temporal_smoothing, configuration.smoothing_kernel);
+}
+
+
+const LV::Spectrogram& LV::Generator::get_pyramid_level(int level) const
+{ return level == 0 ? smoothed_dft_data : pyramid[level-1]; }
+
+
+// Builds the pyramid of the smoothed DFT data up to the given level, each level from
+// the one below it.
+void LV::Generator::generate_pyramid(int last_level)
+{
+	if(pyramid_key != smoothed_dft_key)
+	{
+		pyramid.clear();
+		pyramid_key = smoothed_dft_key;
+	}
+
+	while(static_cast<int>(pyramid.size()) < last_level)
+	{
+		check_cancellation();
+		LV::Spectrogram level;
+		LV::Smoothing::downsample(get_pyramid_level(
+			static_cast<int>(pyramid.size())), &level, 2, 2);
+
+		pyramid.emplace_back(std::move(level));
+	}
+}
+
+
+// Transforms the audio at a fraction of the resolution for a quick preview, taking
+// every preview_scale-th DFT and averaging every preview_scale frequencies. This also
+// memoizes or caches the audio for the full resolution transform. Returns false if
+// the full resolution is already small enough or the audio is too short to preview.
+bool LV::Generator::generate_preview_dft_data(const std::string& file_name,
+	float start, float end, const std::string& audio_key)
+{
+	open_audio_data(file_name, start, end, audio_key);
+	LV::STFT::Settings stft_settings{get_stft_settings(sample_rate)};
+	update_frequency_spacing();
+
+	const int level{stft_settings.hop_size < 1 ? 0 : get_preview_level(
+		estimated_sample_count/stft_settings.hop_size,
+		LV::STFT::get_column_count(stft_settings))};
+
+	if(level == 0)
+	{
+		close_audio_data(false);
+		return false;
 	}
 
+	std::cout<<"Generating the preview...\n";
+	preview_scale = 1 << level;
+	stft_settings.hop_size *= preview_scale;
+	LV::Spectrogram preview_raw_dft_data;
 
-	void generate_dft_mesh()
+	try
+	{
+		LV::STFT::transform([this](float* destination, size_t count)
+			{ return read_audio_data(destination, count); },
+			stft_settings, &preview_raw_dft_data, estimated_sample_count);
+	}
+	catch(...)
 	{
-		std::cout<<"Generating the DFT mesh...\n";
-		dft_mesh.vertices.clear();
-		dft_mesh.indices.clear();
+		close_audio_data(false);
+		throw;
+	}
+
+	close_audio_data(true);
+	if(preview_raw_dft_data.get_rows() < 2) return false;
+
+	LV::Smoothing::downsample(preview_raw_dft_data, &preview_dft_data, 1, preview_scale);
+
+	preview_dft_peak = LV::Smoothing::smooth(&preview_dft_data,
+		get_scaled_harmonic_smoothing()/preview_scale,
+		configuration.temporal_smoothing/preview_scale, configuration.smoothing_kernel);
+
+	return true;
+}
+
+
+// Normalizes the value and scales it to the height. Normalizing while generating
+// the meshes avoids keeping a normalized copy of the DFT data.
+float LV::Generator::get_vertex_height(int z, int x) const
+{
+	const float value{mesh_data->get(z, x)/mesh_peak};
+	return std::min(std::max(value, 0.f), 1.f)*height;
+}
+
+
+// Generates the DFT mesh into preallocated buffers, with the DFTs in parallel. The x
+// position of each frequency is the same in every DFT, so it is computed once.
+void LV::Generator::generate_dft_mesh()
+{
+	std::cout<<"Generating the DFT mesh...\n";
+	const size_t columns{static_cast<size_t>(size.x)};
+	const size_t rows{static_cast<size_t>(size.y)};
+
+	// Position the frequencies. Banded frequencies are already spaced on their scale,
+	// so they are not warped again.
+	std::vector<float> column_positions(columns);
+	float vertex_x{};
 
-		// For each DFT...
-		for(int z{}; z < size.y; ++z)
+	for(size_t x{}; x < columns; ++x)
+	{
+		if(configuration.logarithmic && configuration.band_count == 0)
 		{
-			// For each value in the DFT...
-			float previous_vertex_x{};
-			for(int x{}; x < size.x; ++x)
-			{
-				// Generate the vertex.
-				if(logarithmic)
-				{
-					float normalized_x{x/static_cast<float>(size.x)};
-					float log_x{std::clamp(-std::logf(normalized_x), .1f, 3.f)};
-					float vertex_x{previous_vertex_x+log_x};
-					add_vertex(&dft_mesh, glm::fvec3{vertex_x, dft_data[z][x], z});
-					previous_vertex_x = vertex_x;
-				}
-
-				else add_vertex(&dft_mesh, glm::fvec3{x, dft_data[z][x], z});
-
-				// Generate the indices.
-				if(z >= size.y-1 || x >= size.x-1) continue;
-
-				const unsigned top_left{static_cast<unsigned>(z*size.x+x)};
-				const unsigned	bottom_left{static_cast<unsigned>(top_left+size.x)};
-				const unsigned	bottom_right{bottom_left+1};
-				const unsigned	top_right{top_left+1};
-
-				generate_square_indicies(&dft_mesh.indices,
-					top_left, bottom_left, bottom_right, top_right);
-			}
+			const float normalized_x{x/static_cast<float>(size.x)};
+			vertex_x += std::clamp(-std::logf(normalized_x), .1f, 3.f)*frequency_spacing;
 		}
+
+		else vertex_x = x*frequency_spacing;
+
+		column_positions[x] = center(glm::fvec3{vertex_x, 0.f, 0.f}).x;
 	}
 
+	// Allocate the buffers.
+	const size_t square_columns{columns > 0 ? columns-1 : 0};
+	dft_mesh.vertices.resize(columns*rows);
+	dft_mesh.indices.resize(rows > 0 ? square_columns*(rows-1)*6 : 0);
 
-	void generate_side_mesh(bool iterate_x, bool extreme)
+	// For each DFT...
+	LV::ThreadPool::parallel_for(rows, mesh_row_grain_size, [&](size_t begin, size_t end)
 	{
-		const int max{iterate_x ? size.x : size.y};
-		const int static_value{extreme ? iterate_x ? size.y-1 : size.x-1 : 0};
-		int z{static_value}, x{static_value};
+		std::vector<float> values(columns);
 
-		for(int index{}; index < max; ++index)
+		for(size_t z{begin}; z < end; ++z)
 		{
-			if(iterate_x) x = index; else z = index;
+			check_cancellation();
 
-			// Generate the verticies (top and bottom).
-			add_vertex(&base_mesh, glm::fvec3{x, dft_data[z][x], z});
-			add_vertex(&base_mesh, glm::fvec3{x, LV::Constants::bottom, z});
+			// Generate the vertices.
+			mesh_data->load(z, 0, columns, values.data());
+			const float vertex_z{center(glm::fvec3{0.f, 0.f, static_cast<float>(z)}).z};
+			glm::fvec3* vertices{dft_mesh.vertices.data()+z*columns};
 
-			// Generate the indicies.
-			if(index >= max-1) continue;
+			for(size_t x{}; x < columns; ++x)
+			{
+				const float value{std::min(std::max(values[x]/mesh_peak, 0.f), 1.f)};
+				vertices[x] = {column_positions[x], value*height, vertex_z};
+			}
 
-			const unsigned base_index{static_cast<unsigned>(base_mesh.vertices.size()-2)};
-			const bool couterclockwise{iterate_x ? extreme : !extreme};
+			// Generate the indices of the squares between this DFT and the next.
+			if(z >= rows-1) continue;
+			unsigned* indices{dft_mesh.indices.data()+z*square_columns*6};
 
-			if(couterclockwise) generate_square_indicies(&base_mesh.indices,
-				base_index, base_index+1, base_index+3, base_index+2);
+			for(size_t x{}; x < square_columns; ++x)
+			{
+				const unsigned top_left{static_cast<unsigned>(z*columns+x)};
+				const unsigned bottom_left{static_cast<unsigned>(top_left+columns)};
+				const unsigned bottom_right{bottom_left+1};
+				const unsigned top_right{top_left+1};
 
-			else generate_square_indicies(&base_mesh.indices,
-				base_index+2, base_index+3, base_index+1, base_index);
+				generate_square_indicies(indices+x*6,
+					top_left, bottom_left, bottom_right, top_right);
+			}
 		}
-	}
+	});
+}
 
 
-	void generate_bottom_mesh()
+void LV::Generator::generate_side_mesh(bool iterate_x, bool extreme)
+{
+	const int max{iterate_x ? size.x : size.y};
+	const int static_value{extreme ? iterate_x ? size.y-1 : size.x-1 : 0};
+	int z{static_value}, x{static_value};
+
+	for(int index{}; index < max; ++index)
 	{
-		const unsigned base_index{static_cast<unsigned>(base_mesh.vertices.size())};
+		if(iterate_x) x = index; else z = index;
 
-		// Generate the vertices (top-left, bottom-left, bottom-right, top-right).
-		add_vertex(&base_mesh, glm::fvec3{0.f, LV::Constants::bottom, size.y-1});
-		add_vertex(&base_mesh, glm::fvec3{size.x-1, LV::Constants::bottom, size.y-1});
-		add_vertex(&base_mesh, glm::fvec3{0.f, LV::Constants::bottom, 0.f});
-		add_vertex(&base_mesh, glm::fvec3{size.x-1, LV::Constants::bottom, 0.f});
+		// Generate the verticies (top and bottom).
+		add_vertex(&base_mesh, glm::fvec3{x*frequency_spacing, get_vertex_height(z, x), z});
+		add_vertex(&base_mesh, glm::fvec3{x*frequency_spacing, LV::Constants::bottom, z});
 
 		// Generate the indicies.
-		generate_square_indicies(&base_mesh.indices,
-			base_index, base_index+2, base_index+3, base_index+1);
+		if(index >= max-1) continue;
+
+		const unsigned base_index{static_cast<unsigned>(base_mesh.vertices.size()-2)};
+		const bool couterclockwise{iterate_x ? extreme : !extreme};
+
+		if(couterclockwise) generate_square_indicies(&base_mesh.indices,
+			base_index, base_index+1, base_index+3, base_index+2);
+
+		else generate_square_indicies(&base_mesh.indices,
+			base_index+2, base_index+3, base_index+1, base_index);
 	}
+}
 
 
-	void generate_base_mesh()
-	{
-		base_mesh.vertices.clear();
-		base_mesh.indices.clear();
+void LV::Generator::generate_bottom_mesh()
+{
+	const unsigned base_index{static_cast<unsigned>(base_mesh.vertices.size())};
+	const float width{(size.x-1)*frequency_spacing};
+
+	// Generate the vertices (top-left, bottom-left, bottom-right, top-right).
+	add_vertex(&base_mesh, glm::fvec3{0.f, LV::Constants::bottom, size.y-1});
+	add_vertex(&base_mesh, glm::fvec3{width, LV::Constants::bottom, size.y-1});
+	add_vertex(&base_mesh, glm::fvec3{0.f, LV::Constants::bottom, 0.f});
+	add_vertex(&base_mesh, glm::fvec3{width, LV::Constants::bottom, 0.f});
+
+	// Generate the indicies.
+	generate_square_indicies(&base_mesh.indices,
+		base_index, base_index+2, base_index+3, base_index+1);
+}
 
-		// Generate a mesh for each side.
-		generate_side_mesh(true, false);
-		generate_side_mesh(true, true);
-		generate_side_mesh(false, false);
-		generate_side_mesh(false, true);
 
-		// Generate a mesh for the bottom.
-		generate_bottom_mesh();
-	}
+void LV::Generator::generate_base_mesh()
+{
+	base_mesh.vertices.clear();
+	base_mesh.indices.clear();
+
+	// Each side has two vertices and one square per value along it, and the bottom
+	// has one square.
+	const size_t perimeter{2*static_cast<size_t>(size.x+size.y)};
+	base_mesh.vertices.reserve(2*perimeter+4);
+	base_mesh.indices.reserve(6*perimeter+6);
+
+	// Generate a mesh for each side.
+	generate_side_mesh(true, false);
+	generate_side_mesh(true, true);
+	generate_side_mesh(false, false);
+	generate_side_mesh(false, true);
+
+	// Generate a mesh for the bottom.
+	generate_bottom_mesh();
+}
 
 
-	void generate_meshes()
-	{
-		center_matrix = glm::translate(glm::fvec3{-size.x/2.f, 0.f, -size.y/2.f});
+// Generates the meshes from the given data, each value of which spans scale DFTs and
+// scale frequencies. The model keeps the same dimensions at any scale.
+void LV::Generator::generate_meshes(const LV::Spectrogram& data, float peak, int scale)
+{
+	mesh_data = &data;
+	mesh_peak = peak;
+	mesh_scale = scale;
+	size = {data.get_columns(), data.get_rows()};
 
-		generate_dft_mesh();
-		generate_base_mesh();
-	}
+	center_scale = {scale, 1.f, scale};
+	center_offset = {-size.x*frequency_spacing*scale/2.f, 0.f, -size.y*scale/2.f};
 
+	generate_dft_mesh();
+	generate_base_mesh();
+}
 
-	void nonnegative_validation(float x, const std::string& name)
+
+void LV::Generator::update_height()
+{ height = get_stft_settings(sample_rate).window_size/2.f*configuration.height_multiplier; }
+
+
+// Returns the inputs of each stage.
+LV::Generator::StageKeys LV::Generator::get_stage_keys(
+	const std::string& file_name, float start, float end) const
+{
+	StageKeys keys;
+
+	keys.audio = LV::Utilities::get_file_signature(file_name)+"\n"+
+		std::to_string(start)+" "+std::to_string(end)+" "+
+		std::to_string(configuration.draft_sample_rate);
+
+	keys.raw_dft = keys.audio+"\n"+std::to_string(configuration.dft_window_duration)+" "+
+		std::to_string(configuration.dft_sample_interval)+" "+
+		std::to_string(configuration.zero_padding)+" "+
+		std::to_string(configuration.band_count)+" "+
+		std::to_string(static_cast<int>(configuration.band_scale));
+
+	keys.harmonic_dft = keys.raw_dft+"\n"+std::to_string(configuration.harmonic_smoothing)+
+		" "+std::to_string(static_cast<int>(configuration.smoothing_kernel));
+
+	keys.smoothed_dft = keys.harmonic_dft+"\n"+
+		std::to_string(configuration.temporal_smoothing);
+
+	keys.mesh = keys.smoothed_dft+"\n"+std::to_string(configuration.height_multiplier)+" "+
+		std::to_string(configuration.logarithmic);
+
+	return keys;
+}
+
+
+// Loads the smoothed DFT data from the disk cache if it was saved by an earlier run,
+// skipping the decoding, DFT, and smoothing entirely.
+bool LV::Generator::open_cached_smoothed_dft_data(const StageKeys& keys)
+{
+	smoothed_dft_key.clear();
+	mesh_key.clear();
+	set_storage_format(&smoothed_dft_data);
+
+	if(!LV::Cache::open_spectrogram(&smoothed_dft_data,
+		&smoothed_dft_peak, &sample_rate, keys.smoothed_dft)) return false;
+
+	std::cout<<"Loaded the cached DFT data.\n";
+	update_frequency_spacing();
+
+	if(keys.raw_dft != raw_dft_key)
 	{
-		if(x < 0) throw std::runtime_error{"The "+name+" value cannot be negative."};
+		raw_dft_key.clear();
+		harmonic_dft_key.clear();
 	}
 
+	smoothed_dft_key = keys.smoothed_dft;
+	return true;
+}
 
-	void minmax_validation(float x, float minimum, float maximum, const std::string& name)
-	{
-		if(x <= minimum) throw std::runtime_error{
-			"The "+name+" value must be above "+std::to_string(minimum)+"."};
 
-		if(x > maximum) throw std::runtime_error{
-			"The "+name+" value must be below "+std::to_string(maximum)+"."};
+// Regenerates the raw DFT data unless it is memoized.
+void LV::Generator::update_raw_dft_data(const std::string& file_name, float start,
+	float end, const StageKeys& keys)
+{
+	if(keys.raw_dft == raw_dft_key && raw_dft_data) return;
+
+	raw_dft_key.clear();
+	open_audio_data(file_name, start, end, keys.audio);
+
+	try{ generate_raw_dft_data(); }
+	catch(...)
+	{
+		if(audio_open) close_audio_data(false);
+		throw;
 	}
+
+	raw_dft_key = keys.raw_dft;
+}
+
+
+// Regenerates the harmonically smoothed DFT data unless it is memoized.
+void LV::Generator::update_harmonic_dft_data(const std::string& file_name, float start,
+	float end, const StageKeys& keys)
+{
+	if(keys.harmonic_dft == harmonic_dft_key && harmonic_dft_data) return;
+
+	harmonic_dft_key.clear();
+	update_raw_dft_data(file_name, start, end, keys);
+	check_cancellation();
+	generate_harmonic_dft_data();
+	harmonic_dft_key = keys.harmonic_dft;
 }
 
 
+LV::Generator::Generator(const GeneratorConfiguration& configuration)
+{ set_configuration(configuration); }
+
+
 void LV::Generator::configure(float dft_window_duration, float dft_sample_interval,
 	float harmonic_smoothing, float temporal_smoothing, float height_multiplier,
 	const std::string& logarithmic)
 {
 	std::cout<<"Configuring...\n";
 
+	configure(&configuration, dft_window_duration, dft_sample_interval,
+		harmonic_smoothing, temporal_smoothing, height_multiplier, logarithmic);
+
+	std::cout<<"Configured.\n";
+}
+
+
+// Validates the values and applies them to the configuration, without printing.
+void LV::Generator::configure(GeneratorConfiguration* configuration,
+	float dft_window_duration, float dft_sample_interval, float harmonic_smoothing,
+	float temporal_smoothing, float height_multiplier, const std::string& logarithmic)
+{
 	// Validate.
 	if(logarithmic != "true" && logarithmic != "false") throw std::runtime_error{
 		"The logarithmic value must be either \"true\" or \"false\"."};
@@ -408,34 +778,266 @@ void LV::Generator::configure(float dft_window_duration, float dft_sample_interv
 	minmax_validation(height_multiplier, .1f, 10.f, "height multiplier");
 
 	// Apply.
-	::dft_window_duration = dft_window_duration;
-	::dft_sample_interval = dft_sample_interval;
-	::harmonic_smoothing = static_cast<int>(harmonic_smoothing);
-	::temporal_smoothing = static_cast<int>(temporal_smoothing);
-	::height_multiplier = height_multiplier;
-	::logarithmic = logarithmic == "true" ? true : false;
+	configuration->dft_window_duration = dft_window_duration;
+	configuration->dft_sample_interval = dft_sample_interval;
+	configuration->harmonic_smoothing = static_cast<int>(harmonic_smoothing);
+	configuration->temporal_smoothing = static_cast<int>(temporal_smoothing);
+	configuration->height_multiplier = height_multiplier;
+	configuration->logarithmic = logarithmic == "true" ? true : false;
+}
 
-	std::cout<<"Configured.\n";
+
+void LV::Generator::set_option(const std::string& option, const std::string& value)
+{
+	if(option == "draft")
+	{
+		if(value == "off") configuration.draft_sample_rate = 0;
+		else
+		{
+			const float sample_rate{std::stof(value)};
+			minmax_validation(sample_rate, 1000.f, 192000.f, "draft sample rate");
+			configuration.draft_sample_rate = static_cast<int>(sample_rate);
+		}
+	}
+
+	else if(option == "zero_padding")
+	{
+		if(value != "on" && value != "off") throw std::runtime_error{
+			"The zero padding value must be either \"on\" or \"off\"."};
+
+		configuration.zero_padding = value == "on";
+	}
+
+	else if(option == "bands")
+	{
+		if(value == "off") configuration.band_count = 0;
+		else
+		{
+			const float count{std::stof(value)};
+			minmax_validation(count, 1.f, 65536.f, "band count");
+			configuration.band_count = static_cast<int>(count);
+		}
+	}
+
+	else if(option == "band_scale")
+		configuration.band_scale = LV::STFT::get_band_scale(value);
+
+	else if(option == "smoothing_kernel")
+		configuration.smoothing_kernel = LV::Smoothing::get_kernel(value);
+
+	else if(option == "storage")
+	{
+		if(value != "float32" && value != "uint16") throw std::runtime_error{
+			"The storage value must be either \"float32\" or \"uint16\"."};
+
+		GeneratorConfiguration configuration{this->configuration};
+		configuration.storage_format = value == "uint16" ?
+			LV::Spectrogram::Format::uint16 : LV::Spectrogram::Format::float32;
+
+		set_configuration(configuration);
+	}
+
+	else throw std::runtime_error{"Unrecognized option \""+option+"\"."};
+
+	std::cout<<"Set.\n";
+}
+
+
+void LV::Generator::set_configuration(const GeneratorConfiguration& configuration)
+{
+	// The storage format is not part of the stage inputs, so that the disk cache is
+	// shared between formats. Regenerate the stored data in the new format instead.
+	if(configuration.storage_format != this->configuration.storage_format)
+	{
+		raw_dft_key.clear();
+		harmonic_dft_key.clear();
+		smoothed_dft_key.clear();
+		mesh_key.clear();
+		raw_dft_data.reset();
+		harmonic_dft_data.reset();
+		smoothed_dft_data.clear();
+	}
+
+	this->configuration = configuration;
+}
+
+
+// Gives the other generator this generator's raw DFT data without copying it, so if the
+// other generator is then used on the same audio with the same DFT settings, it only
+// smooths the data and generates the meshes.
+void LV::Generator::share_raw_dft_data(Generator* other) const
+{
+	if(!raw_dft_data || raw_dft_key.empty() ||
+		other->configuration.storage_format != configuration.storage_format) return;
+
+	other->raw_dft_key = raw_dft_key;
+	other->raw_dft_data = raw_dft_data;
+	other->sample_rate = sample_rate;
+	other->update_frequency_spacing();
+}
+
+
+void LV::Generator::generate(const std::string& file_name, float start, float end,
+	const LevelCallback& on_level, const std::atomic<bool>* cancelled)
+{
+	cancellation = cancelled;
+	validate_generation(file_name, start, end);
+	const StageKeys keys{get_stage_keys(file_name, start, end)};
+
+	// Regenerate the stages whose inputs changed, invalidating the stages after them.
+	if(keys.smoothed_dft != smoothed_dft_key && !open_cached_smoothed_dft_data(keys))
+	{
+		update_harmonic_dft_data(file_name, start, end, keys);
+		check_cancellation();
+		generate_smoothed_dft_data();
+		smoothed_dft_key = keys.smoothed_dft;
+
+		LV::Cache::save_spectrogram(smoothed_dft_data,
+			smoothed_dft_peak, sample_rate, smoothed_dft_key);
+	}
+
+	update_height();
+
+	if(keys.mesh != mesh_key)
+	{
+		mesh_key.clear();
+
+		// Generate the coarser levels of detail first, so they can be shown while the
+		// full resolution meshes are generated.
+		if(on_level)
+		{
+			const int preview_level{get_preview_level(
+				smoothed_dft_data.get_rows(), smoothed_dft_data.get_columns())};
+
+			generate_pyramid(preview_level);
+
+			for(int level{preview_level-1}; level > 0; --level)
+			{
+				generate_meshes(get_pyramid_level(level), smoothed_dft_peak, 1 << level);
+				on_level(level);
+			}
+		}
+
+		generate_meshes(smoothed_dft_data, smoothed_dft_peak, 1);
+		mesh_key = keys.mesh;
+	}
+
+	if(on_level) on_level(0);
+}
+
+
+// Generates only the raw DFT data, even if later stages are memoized or cached, so it
+// can be shared with other generators.
+void LV::Generator::transform(const std::string& file_name, float start, float end)
+{
+	cancellation = nullptr;
+	validate_generation(file_name, start, end);
+	update_raw_dft_data(file_name, start, end, get_stage_keys(file_name, start, end));
+}
+
+
+// Quickly generates coarse meshes to show while the full resolution meshes are
+// generated. Uses the pyramid of the smoothed DFT data if it is memoized or cached, and
+// otherwise transforms the audio at a fraction of the resolution. Returns false if
+// there is nothing to preview, either because the full resolution meshes are already
+// memoized or because they are small enough to generate quickly.
+bool LV::Generator::generate_preview(const std::string& file_name, float start, float end)
+{
+	cancellation = nullptr;
+	validate_generation(file_name, start, end);
+	const StageKeys keys{get_stage_keys(file_name, start, end)};
+	if(keys.mesh == mesh_key) return false;
+	mesh_key.clear();
+
+	if(keys.smoothed_dft == smoothed_dft_key || open_cached_smoothed_dft_data(keys))
+	{
+		const int level{get_preview_level(
+			smoothed_dft_data.get_rows(), smoothed_dft_data.get_columns())};
+
+		if(level == 0) return false;
+
+		generate_pyramid(level);
+		update_height();
+		generate_meshes(get_pyramid_level(level), smoothed_dft_peak, 1 << level);
+		return true;
+	}
+
+	if(!generate_preview_dft_data(file_name, start, end, keys.audio)) return false;
+
+	update_height();
+	generate_meshes(preview_dft_data, preview_dft_peak, preview_scale);
+	return true;
+}
+
+
+// Estimates the number of vertices of the DFT mesh generated from the given number of
+// samples, one for each frequency of each DFT.
+size_t LV::Generator::estimate_vertex_count(int sample_rate, size_t sample_count) const
+{
+	const LV::STFT::Settings stft_settings{get_stft_settings(sample_rate)};
+	if(stft_settings.hop_size <= 0) return 0;
+
+	return (sample_count/stft_settings.hop_size+1)*
+		static_cast<size_t>(LV::STFT::get_column_count(stft_settings));
 }
 
 
-void LV::Generator::generate(const std::string& file_name)
+// Estimates the peak memory in bytes used to generate the given number of samples,
+// counting the memoized samples, the transform's buffers, the raw, harmonically
+// smoothed, and smoothed DFT data, the copy made to cache the smoothed data, and the
+// meshes.
+size_t LV::Generator::estimate_memory(int sample_rate, size_t sample_count) const
 {
-	// Load the audio data.
-	load_audio_data(file_name);
+	const LV::STFT::Settings stft_settings{get_stft_settings(sample_rate)};
+	if(stft_settings.hop_size <= 0) return 0;
+
+	const size_t vertex_count{estimate_vertex_count(sample_rate, sample_count)};
+
+	const size_t element_size{configuration.storage_format ==
+		LV::Spectrogram::Format::uint16 ? sizeof(uint16_t) : sizeof(float)};
+
+	const size_t audio{sample_count <= maximum_memoized_samples ?
+		sample_count*sizeof(float) : 0};
 
-	// Generate the DFT data.
-	generate_dft_data();
+	const size_t mesh{vertex_count*(sizeof(glm::fvec3)+6*sizeof(unsigned))};
 
-	// Generate the meshes.
-	generate_meshes();
+	return audio+LV::STFT::get_buffer_memory(stft_settings)+
+		3*vertex_count*element_size+LV::Cache::estimate_save_memory(vertex_count)+mesh;
 }
 
 
-glm::ivec2 LV::Generator::get_size(){ return size; }
+const LV::GeneratorConfiguration& LV::Generator::get_configuration() const
+{ return configuration; }
 
-float LV::Generator::get_height(){ return height; }
+glm::ivec2 LV::Generator::get_size() const { return size*mesh_scale; }
 
-LV::Mesh LV::Generator::get_dft_mesh(){ return dft_mesh; }
+float LV::Generator::get_height() const { return height; }
 
-LV::Mesh LV::Generator::get_base_mesh(){ return base_mesh; }
+const LV::Mesh& LV::Generator::get_dft_mesh() const { return dft_mesh; }
+
+const LV::Mesh& LV::Generator::get_base_mesh() const { return base_mesh; }
+
+
+// Returns the bytes held by the memoized stages. Raw DFT data shared with other
+// generators is counted by each of them, and harmonically smoothed data that is the raw
+// DFT data is counted once.
+size_t LV::Generator::get_memory_size() const
+{
+	const auto get_mesh_size{[](const Mesh& mesh)
+	{
+		return mesh.vertices.capacity()*sizeof(glm::fvec3)+
+			mesh.indices.capacity()*sizeof(unsigned);
+	}};
+
+	size_t size{audio_samples.capacity()*sizeof(float)+
+		smoothed_dft_data.get_memory_size()+preview_dft_data.get_memory_size()+
+		get_mesh_size(dft_mesh)+get_mesh_size(base_mesh)};
+
+	if(raw_dft_data) size += raw_dft_data->get_memory_size();
+
+	if(harmonic_dft_data && harmonic_dft_data != raw_dft_data)
+		size += harmonic_dft_data->get_memory_size();
+
+	for(const Spectrogram& level : pyramid) size += level.get_memory_size();
+	return size;
+}
@@ -9,8 +9,17 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
 #include <glm/glm.hpp>
 
+#include "Decoder.hpp"
+#include "Cache.hpp"
+#include "Spectrogram.hpp"
+#include "STFT.hpp"
+#include "Smoothing.hpp"
+
 
 namespace LV
 {
@@ -19,23 +28,204 @@ namespace LV
 		std::vector<glm::fvec3> vertices;
 		std::vector<unsigned> indices;
 	};
-}
 
 
-namespace LV::Generator
-{
-	void configure(float dft_window_duration, float sample_interval,
-		float harmonic_smoothing, float temporal_smoothing,
-		float height_multiplier, const std::string& logarithmic);
+	struct GeneratorConfiguration
+	{
+		float dft_window_duration{30.f}; // Milliseconds.
+		float dft_sample_interval{1.f}; // Milliseconds.
+		int harmonic_smoothing{15}; // Frequencies.
+		int temporal_smoothing{0}; // DFTs.
+		float height_multiplier{.33f};
+		bool logarithmic{false};
+		int draft_sample_rate{0}; // Hertz.
+		bool zero_padding{false};
+		int band_count{0};
+		STFT::BandScale band_scale{STFT::BandScale::log};
+		Smoothing::Kernel smoothing_kernel{Smoothing::Kernel::box};
+		Spectrogram::Format storage_format{Spectrogram::Format::float32};
+	};
+
+
+	// Generates the meshes for audio files. Each generator owns its configuration and
+	// the memoized stages of its last generation, so separate generators can be used on
+	// separate threads.
+	class Generator
+	{
+	public:
+		// Receives each level of detail once its meshes are generated, from the coarsest
+		// to level 0, the full resolution. Each level halves the resolution of the one
+		// below it.
+		using LevelCallback = std::function<void(int level)>;
+
+		explicit Generator(const GeneratorConfiguration& configuration = {});
+
+		Generator(const Generator&) = delete;
+		Generator& operator=(const Generator&) = delete;
+
+		void configure(float dft_window_duration, float sample_interval,
+			float harmonic_smoothing, float temporal_smoothing,
+			float height_multiplier, const std::string& logarithmic);
+
+		static void configure(GeneratorConfiguration* configuration,
+			float dft_window_duration, float sample_interval,
+			float harmonic_smoothing, float temporal_smoothing,
+			float height_multiplier, const std::string& logarithmic);
+
+		void set_option(const std::string& option, const std::string& value);
+
+		void set_configuration(const GeneratorConfiguration& configuration);
+
+		void generate(const std::string& file_name, float start = 0.f, float end = 0.f,
+			const LevelCallback& on_level = {}, const std::atomic<bool>* cancelled = nullptr);
+
+		bool generate_preview(const std::string& file_name, float start = 0.f, float end = 0.f);
+
+		void transform(const std::string& file_name, float start = 0.f, float end = 0.f);
+
+		size_t estimate_vertex_count(int sample_rate, size_t sample_count) const;
+
+		size_t estimate_memory(int sample_rate, size_t sample_count) const;
+
+		void share_raw_dft_data(Generator* other) const;
+
+
+		// Getters.
+		const GeneratorConfiguration& get_configuration() const;
+
+		glm::ivec2 get_size() const;
+
+		float get_height() const;
+
+		const Mesh& get_dft_mesh() const;
+
+		const Mesh& get_base_mesh() const;
+
+		size_t get_memory_size() const;
+
+	private:
+		struct StageKeys
+		{
+			std::string audio;
+			std::string raw_dft;
+			std::string harmonic_dft;
+			std::string smoothed_dft;
+			std::string mesh;
+		};
+
+		GeneratorConfiguration configuration;
+
+		glm::ivec2 size{};
+		float height{};
+		float frequency_spacing{}; // The mesh width of each frequency.
+		glm::fvec3 center_scale{1.f};
+		glm::fvec3 center_offset{};
+		const std::atomic<bool>* cancellation{nullptr};
+
+		std::unique_ptr<Decoder> decoder;
+		CachedPCM cached_pcm;
+		PCMCacheWriter pcm_cache_writer;
+		bool audio_open{false};
+		bool audio_memoized{false};
+		size_t audio_position{};
+		size_t audio_end{};
+		int sample_rate{};
+		size_t estimated_sample_count{};
 
-	void generate(const std::string& file_name);
+		// Each stage is kept along with a key describing the inputs it was generated
+		// from, so only the stages whose inputs changed are regenerated. An empty key
+		// marks a stage that must be regenerated.
+		std::string audio_key;
+		std::string pending_audio_key;
+		std::vector<float> audio_samples;
+		int audio_sample_rate{};
 
-	// Getters.
-	glm::ivec2 get_size();
+		std::string raw_dft_key;
+		std::shared_ptr<const Spectrogram> raw_dft_data;
 
-	float get_height();
+		// Only harmonically smoothed, so variants that only differ in their temporal
+		// smoothing reuse it. Without harmonic smoothing, it is the raw DFT data.
+		std::string harmonic_dft_key;
+		std::shared_ptr<const Spectrogram> harmonic_dft_data;
 
-	Mesh get_dft_mesh();
+		std::string smoothed_dft_key;
+		Spectrogram smoothed_dft_data;
+		float smoothed_dft_peak{};
 
-	Mesh get_base_mesh();
+		// Each level of the pyramid halves the resolution of the smoothed DFT data in
+		// both time and frequency. The vector holds levels 1 and above.
+		std::string pyramid_key;
+		std::vector<Spectrogram> pyramid;
+
+		Spectrogram preview_dft_data;
+		float preview_dft_peak{};
+		int preview_scale{};
+
+		std::string mesh_key;
+		const Spectrogram* mesh_data{nullptr};
+		float mesh_peak{};
+		int mesh_scale{1}; // DFTs and frequencies per vertex.
+		Mesh dft_mesh;
+		Mesh base_mesh;
+
+		void check_cancellation() const;
+
+		glm::fvec3 center(const glm::fvec3& vertex) const;
+
+		void add_vertex(Mesh* mesh, const glm::fvec3& vertex);
+
+		void open_audio_data(const std::string& file_name, float start, float end,
+			const std::string& key);
+
+		void memoize_audio_data(const float* samples, size_t count);
+
+		size_t read_audio_data(float* destination, size_t count);
+
+		void close_audio_data(bool completed);
+
+		STFT::Settings get_stft_settings(int sample_rate) const;
+
+		void update_frequency_spacing();
+
+		int get_scaled_harmonic_smoothing() const;
+
+		void set_storage_format(Spectrogram* spectrogram);
+
+		void generate_raw_dft_data();
+
+		void generate_harmonic_dft_data();
+
+		void generate_smoothed_dft_data();
+
+		const Spectrogram& get_pyramid_level(int level) const;
+
+		void generate_pyramid(int last_level);
+
+		bool generate_preview_dft_data(const std::string& file_name,
+			float start, float end, const std::string& audio_key);
+
+		float get_vertex_height(int z, int x) const;
+
+		void generate_dft_mesh();
+
+		void generate_side_mesh(bool iterate_x, bool extreme);
+
+		void generate_bottom_mesh();
+
+		void generate_base_mesh();
+
+		void generate_meshes(const Spectrogram& data, float peak, int scale);
+
+		void update_height();
+
+		StageKeys get_stage_keys(const std::string& file_name, float start, float end) const;
+
+		bool open_cached_smoothed_dft_data(const StageKeys& keys);
+
+		void update_raw_dft_data(const std::string& file_name, float start, float end,
+			const StageKeys& keys);
+
+		void update_harmonic_dft_data(const std::string& file_name, float start, float end,
+			const StageKeys& keys);
+	};
 }
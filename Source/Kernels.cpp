@@ -0,0 +1,318 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#include "Kernels.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define LV_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LV_AVX2_TARGET
+#else
+#define LV_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+namespace
+{
+	// Converts natural logarithms to decibels of power (10*log10).
+	constexpr float decibels_per_neper{4.3429448f};
+
+	// Natural logarithm coefficients for mantissas in [sqrt(.5)-1, sqrt(2)-1), from Cephes.
+	constexpr float log_coefficients[]{7.0376836292e-2f, -1.1514610310e-1f,
+		1.1676998740e-1f, -1.2420140846e-1f, 1.4249322787e-1f, -1.6668057665e-1f,
+		2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f};
+
+	constexpr float sqrt_half{.70710678f};
+	constexpr float ln2_high{.693359375f};
+	constexpr float ln2_low{-2.12194440e-4f};
+	constexpr float minimum_normal{1.17549435e-38f};
+
+	using MultiplyKernel = void(*)(float*, const float*, size_t);
+	using DecibelKernel = void(*)(const std::complex<float>*, float*, size_t, float);
+
+
+	// Approximates the natural logarithm of a positive value. Denormals and zero are
+	// treated as the smallest normal value, which is far below any visible decibel level.
+	float fast_log(float value)
+	{
+		value = std::max(value, minimum_normal);
+
+		// Split the value into its exponent and a mantissa in [.5, 1).
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		float exponent{static_cast<float>(static_cast<int>(bits >> 23)-126)};
+		bits = (bits & 0x807fffffu) | 0x3f000000u;
+
+		float mantissa;
+		std::memcpy(&mantissa, &bits, sizeof(mantissa));
+
+		if(mantissa < sqrt_half)
+		{
+			exponent -= 1.f;
+			mantissa = mantissa+mantissa-1.f;
+		}
+
+		else mantissa -= 1.f;
+
+		// Evaluate the polynomial.
+		const float square{mantissa*mantissa};
+		float result{log_coefficients[0]};
+		for(int index{1}; index < 9; ++index)
+			result = result*mantissa+log_coefficients[index];
+
+		result *= mantissa*square;
+		result += exponent*ln2_low-.5f*square;
+		return mantissa+result+exponent*ln2_high;
+	}
+
+
+	void multiply_scalar(float* samples, const float* multipliers, size_t count)
+	{ for(size_t index{}; index < count; ++index) samples[index] *= multipliers[index]; }
+
+
+	void power_to_decibels_scalar(const std::complex<float>* bins,
+		float* decibels, size_t count, float offset)
+	{
+		for(size_t index{}; index < count; ++index)
+		{
+			const float power{bins[index].real()*bins[index].real()+
+				bins[index].imag()*bins[index].imag()};
+
+			decibels[index] = std::max(decibels_per_neper*fast_log(power)+offset, 0.f);
+		}
+	}
+
+
+	#if defined(LV_X86)
+	LV_AVX2_TARGET __m256 fast_log_avx2(__m256 value)
+	{
+		value = _mm256_max_ps(value, _mm256_set1_ps(minimum_normal));
+
+		// Split the value into its exponent and a mantissa in [.5, 1).
+		const __m256i bits{_mm256_castps_si256(value)};
+		__m256 exponent{_mm256_cvtepi32_ps(_mm256_sub_epi32(
+			_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)))};
+
+		__m256 mantissa{_mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits,
+			_mm256_set1_epi32(0x807fffff)), _mm256_set1_epi32(0x3f000000)))};
+
+		const __m256 one{_mm256_set1_ps(1.f)};
+		const __m256 small{_mm256_cmp_ps(mantissa, _mm256_set1_ps(sqrt_half), _CMP_LT_OQ)};
+		exponent = _mm256_sub_ps(exponent, _mm256_and_ps(one, small));
+		mantissa = _mm256_add_ps(_mm256_sub_ps(mantissa, one), _mm256_and_ps(mantissa, small));
+
+		// Evaluate the polynomial.
+		const __m256 square{_mm256_mul_ps(mantissa, mantissa)};
+		__m256 result{_mm256_set1_ps(log_coefficients[0])};
+		for(int index{1}; index < 9; ++index)
+			result = _mm256_fmadd_ps(result, mantissa, _mm256_set1_ps(log_coefficients[index]));
+
+		result = _mm256_mul_ps(result, _mm256_mul_ps(mantissa, square));
+		result = _mm256_fmadd_ps(exponent, _mm256_set1_ps(ln2_low), result);
+		result = _mm256_fnmadd_ps(_mm256_set1_ps(.5f), square, result);
+		return _mm256_fmadd_ps(exponent, _mm256_set1_ps(ln2_high), _mm256_add_ps(mantissa, result));
+	}
+
+
+	LV_AVX2_TARGET void multiply_avx2(float* samples, const float* multipliers, size_t count)
+	{
+		size_t index{};
+		for(; index+8 <= count; index += 8) _mm256_storeu_ps(samples+index, _mm256_mul_ps(
+			_mm256_loadu_ps(samples+index), _mm256_loadu_ps(multipliers+index)));
+
+		multiply_scalar(samples+index, multipliers+index, count-index);
+	}
+
+
+	LV_AVX2_TARGET void power_to_decibels_avx2(const std::complex<float>* bins,
+		float* decibels, size_t count, float offset)
+	{
+		const float* values{reinterpret_cast<const float*>(bins)};
+		const __m256 scale{_mm256_set1_ps(decibels_per_neper)};
+		const __m256 offsets{_mm256_set1_ps(offset)};
+		size_t index{};
+
+		for(; index+8 <= count; index += 8)
+		{
+			const __m256 first{_mm256_loadu_ps(values+index*2)};
+			const __m256 second{_mm256_loadu_ps(values+index*2+8)};
+
+			// Sum the squared real and imaginary parts, then restore the bin order, since
+			// the horizontal add works within each 128-bit lane.
+			const __m256 sums{_mm256_hadd_ps(_mm256_mul_ps(first, first),
+				_mm256_mul_ps(second, second))};
+
+			const __m256 power{_mm256_castpd_ps(_mm256_permute4x64_pd(
+				_mm256_castps_pd(sums), 0xd8))};
+
+			const __m256 result{_mm256_fmadd_ps(fast_log_avx2(power), scale, offsets)};
+			_mm256_storeu_ps(decibels+index, _mm256_max_ps(result, _mm256_setzero_ps()));
+		}
+
+		power_to_decibels_scalar(bins+index, decibels+index, count-index, offset);
+	}
+
+
+	bool supports_avx2()
+	{
+		#if defined(_MSC_VER) && !defined(__clang__)
+		int registers[4];
+		__cpuid(registers, 1);
+		const bool fma{(registers[2] & (1 << 12)) != 0};
+		const bool os_saves_registers{(registers[2] & (1 << 27)) != 0 &&
+			(_xgetbv(0) & 6) == 6};
+
+		__cpuidex(registers, 7, 0);
+		return fma && os_saves_registers && (registers[1] & (1 << 5)) != 0;
+
+		#else
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		#endif
+	}
+
+	#elif defined(__ARM_NEON)
+	float32x4_t fast_log_neon(float32x4_t value)
+	{
+		value = vmaxq_f32(value, vdupq_n_f32(minimum_normal));
+
+		// Split the value into its exponent and a mantissa in [.5, 1).
+		const uint32x4_t bits{vreinterpretq_u32_f32(value)};
+		float32x4_t exponent{vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(
+			vshrq_n_u32(bits, 23)), vdupq_n_s32(126)))};
+
+		float32x4_t mantissa{vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits,
+			vdupq_n_u32(0x807fffff)), vdupq_n_u32(0x3f000000)))};
+
+		const float32x4_t one{vdupq_n_f32(1.f)};
+		const uint32x4_t small{vcltq_f32(mantissa, vdupq_n_f32(sqrt_half))};
+		exponent = vsubq_f32(exponent, vreinterpretq_f32_u32(
+			vandq_u32(vreinterpretq_u32_f32(one), small)));
+
+		mantissa = vaddq_f32(vsubq_f32(mantissa, one), vreinterpretq_f32_u32(
+			vandq_u32(vreinterpretq_u32_f32(mantissa), small)));
+
+		// Evaluate the polynomial.
+		const float32x4_t square{vmulq_f32(mantissa, mantissa)};
+		float32x4_t result{vdupq_n_f32(log_coefficients[0])};
+		for(int index{1}; index < 9; ++index)
+			result = vmlaq_f32(vdupq_n_f32(log_coefficients[index]), result, mantissa);
+
+		result = vmulq_f32(result, vmulq_f32(mantissa, square));
+		result = vmlaq_f32(result, exponent, vdupq_n_f32(ln2_low));
+		result = vmlsq_f32(result, square, vdupq_n_f32(.5f));
+		return vmlaq_f32(vaddq_f32(mantissa, result), exponent, vdupq_n_f32(ln2_high));
+	}
+
+
+	void multiply_neon(float* samples, const float* multipliers, size_t count)
+	{
+		size_t index{};
+		for(; index+4 <= count; index += 4) vst1q_f32(samples+index,
+			vmulq_f32(vld1q_f32(samples+index), vld1q_f32(multipliers+index)));
+
+		multiply_scalar(samples+index, multipliers+index, count-index);
+	}
+
+
+	void power_to_decibels_neon(const std::complex<float>* bins,
+		float* decibels, size_t count, float offset)
+	{
+		const float* values{reinterpret_cast<const float*>(bins)};
+		size_t index{};
+
+		for(; index+4 <= count; index += 4)
+		{
+			// Deinterleave the real and imaginary parts.
+			const float32x4x2_t parts{vld2q_f32(values+index*2)};
+			const float32x4_t power{vmlaq_f32(vmulq_f32(parts.val[0], parts.val[0]),
+				parts.val[1], parts.val[1])};
+
+			const float32x4_t result{vmlaq_f32(vdupq_n_f32(offset),
+				fast_log_neon(power), vdupq_n_f32(decibels_per_neper))};
+
+			vst1q_f32(decibels+index, vmaxq_f32(result, vdupq_n_f32(0.f)));
+		}
+
+		power_to_decibels_scalar(bins+index, decibels+index, count-index, offset);
+	}
+	#endif
+
+
+	// Selects the fastest kernels supported by the processor.
+	struct Dispatch
+	{
+		MultiplyKernel multiply{multiply_scalar};
+		DecibelKernel power_to_decibels{power_to_decibels_scalar};
+		const char* instruction_set{"scalar"};
+
+		Dispatch()
+		{
+			#if defined(LV_X86)
+			if(supports_avx2())
+			{
+				multiply = multiply_avx2;
+				power_to_decibels = power_to_decibels_avx2;
+				instruction_set = "AVX2";
+			}
+
+			#elif defined(__ARM_NEON)
+			multiply = multiply_neon;
+			power_to_decibels = power_to_decibels_neon;
+			instruction_set = "NEON";
+			#endif
+		}
+	};
+
+
+	const Dispatch& get_dispatch()
+	{
+		static const Dispatch dispatch;
+		return dispatch;
+	}
+}
+
+
+// Multiplies each sample by its corresponding multiplier, in place.
+void LV::Kernels::multiply(float* samples, const float* multipliers, size_t count)
+{ get_dispatch().multiply(samples, multipliers, count); }
+
+
+// Converts the power of each complex bin to decibels (10*log10), adds the offset, and
+// clamps the result at zero.
+void LV::Kernels::power_to_decibels(const std::complex<float>* bins,
+	float* decibels, size_t count, float offset)
+{ get_dispatch().power_to_decibels(bins, decibels, count, offset); }
+
+
+// Averages the power of the bins in each band, [band_edges[band], band_edges[band+1]),
+// and converts it to decibels as above. The bands are few, so this is left scalar.
+void LV::Kernels::band_power_to_decibels(const std::complex<float>* bins,
+	const int* band_edges, float* decibels, size_t band_count, float offset)
+{
+	for(size_t band{}; band < band_count; ++band)
+	{
+		float power{};
+		for(int bin{band_edges[band]}; bin < band_edges[band+1]; ++bin)
+			power += bins[bin].real()*bins[bin].real()+bins[bin].imag()*bins[bin].imag();
+
+		power /= static_cast<float>(band_edges[band+1]-band_edges[band]);
+		decibels[band] = std::max(decibels_per_neper*fast_log(power)+offset, 0.f);
+	}
+}
+
+
+const char* LV::Kernels::get_instruction_set()
+{ return get_dispatch().instruction_set; }
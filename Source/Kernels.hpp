@@ -0,0 +1,25 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#pragma once
+
+#include <complex>
+
+
+namespace LV::Kernels
+{
+	void multiply(float* samples, const float* multipliers, size_t count);
+
+	void power_to_decibels(const std::complex<float>* bins,
+		float* decibels, size_t count, float offset);
+
+	void band_power_to_decibels(const std::complex<float>* bins,
+		const int* band_edges, float* decibels, size_t band_count, float offset);
+
+	// Getters.
+	const char* get_instruction_set();
+}
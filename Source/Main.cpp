@@ -6,13 +6,16 @@
 
 
 #include <iostream>
-#include <regex>
 
 #include "Constants.hpp"
 #include "Utilities.hpp"
 #include "Generator.hpp"
 #include "Viewer.hpp"
 #include "Exporter.hpp"
+#include "Batch.hpp"
+#include "Sweep.hpp"
+#include "Server.hpp"
+#include "STFT.hpp"
 
 
 void print_documentation()
@@ -43,16 +46,60 @@ void print_documentation()
 		"the low frequencies expanded. If it is false, the model will be scaled linearly, "
 		"meaning all frequencies will occupy the same amount of space."
 
+		"\n\nTo change an advanced generation option, enter: 'set <option> <value>'. The "
+		"available options are:"
+
+		"\n\n'draft' downsamples the audio to the given sample rate in hertz, or 'off' to "
+		"use the audio's own sample rate (the default). A lower rate makes every stage of "
+		"generation proportionally faster at the cost of the highest frequencies. For "
+		"example: 'set draft 16000'."
+
+		"\n\n'zero_padding' can be either 'on' or 'off' (the default). If it is on, each DFT "
+		"window is padded with silence to the next size the FFT handles quickly, which can "
+		"make generation considerably faster for window durations with awkward sizes. The "
+		"model keeps its proportions, with more finely spaced frequencies. For example: "
+		"'set zero_padding on'. To see the speedup for common window durations, enter "
+		"'benchmark', optionally followed by a sample rate in hertz."
+
+		"\n\n'bands' can be either a number of bands or 'off' (the default). With bands, the "
+		"frequencies of each DFT are averaged into that many bands right after the FFT, "
+		"spaced on the 'band_scale', which can be either 'log' (the default) or 'mel'. "
+		"This keeps the detail of the low frequencies while generating far fewer "
+		"vertices, and the model keeps its width. The logarithmic configuration has no "
+		"effect on banded frequencies. For example: 'set bands 256' and "
+		"'set band_scale mel'."
+
+		"\n\n'smoothing_kernel' sets how the harmonic and temporal smoothing weight the "
+		"sampled frequencies: 'box' weights them equally (the default), 'hann' tapers them "
+		"with a Hann window, and 'gaussian' with a Gaussian spanning two standard deviations "
+		"in each direction. Smoothing takes the same time regardless of the number of "
+		"frequencies sampled. For example: 'set smoothing_kernel gaussian'."
+
+		"\n\n'storage' can be either 'float32' (the default) or 'uint16'. With 'uint16', the "
+		"DFT data is kept as 16-bit values, halving the memory used by long tracks, at a "
+		"precision of about 0.004 decibels. For example: 'set storage uint16'."
+
 		"\n\n---"
 
 		"\n\nTo preview model generation for an audio file, enter: 'view <file name>'. For "
-		"example: 'view shadowplay.flac'."
+		"example: 'view shadowplay.flac'. To only use an excerpt of the audio file, append "
+		"the start and, optionally, end times in seconds. For example: 'view shadowplay.flac "
+		"60 80'. Large models are first shown at a coarse resolution, which is refined in "
+		"the background."
 		
 		"\n\nThe file name must only contain alphanumeric characters, dashes, and periods "
 		"(no spaces). Place the audio file next to the executable. The supported audio file "
 		"types are: FLAC, MP3, and WAV. Be careful with the length of the audio file. Files "
 		"more than a couple seconds long can be very intensive depending on the configuration."
 
+		"\n\nDecoded audio is cached within the 'Cache' folder, so viewing or exporting the "
+		"same audio file again skips decoding. The smoothed DFT data is also cached within "
+		"the 'Configurations' folder, so generating the same audio file with the same "
+		"settings again skips decoding, the DFTs, and smoothing. Delete these folders to "
+		"clear the caches. Within a session, only the generation stages affected by changed "
+		"settings are redone, so changing just the height multiplier or logarithmic scaling "
+		"is nearly instant."
+
 		"\n\nIn the viewer, navigate using the 'W', 'A', 'S', and 'D' keys and the mouse. Hold "
 		"'Shift' to move faster. Press 'L' to toggle mouse locking. Press the 'F' key to "
 		"toggle wireframe rendering. Use the left and right arrow keys to change the light "
@@ -65,7 +112,7 @@ void print_documentation()
 		"<format> <orientation>'. For example: 'export shadowplay.flac ply z-up'."
 
 		"\n\nThe file name must follow the same guidelines as specified above for the "
-		"'view' command"
+		"'view' command, and the same optional start and end times can be appended."
 		
 		"\n\nThe format must be 'ply', 'obj', or 'stl'. STL is only recommended for very "
 		"small exports. Exporting as OBJ will generate a corresponding MTL file."
@@ -74,6 +121,33 @@ void print_documentation()
 
 		"\n\nExported models will be saved within the 'Exports' folder."
 
+		"\n\nTo export every audio file in a directory, enter: 'batch <directory> <format> "
+		"<orientation>'. For example: 'batch Albums ply z-up'. Every FLAC, MP3, and WAV file "
+		"in the directory is generated with the current settings and exported, several at a "
+		"time, as many as fit in memory. Files that fail are reported and skipped, and a "
+		"summary of the throughput is printed at the end."
+
+		"\n\nTo compare settings, enter: 'sweep <file name> <format> <orientation>' followed "
+		"by the six 'configure' parameters, each given as a comma-separated list of values "
+		"(no spaces). For example: 'sweep shadowplay.flac ply z-up 30 1 5,15,25 0,2 .33,.5 "
+		"false'. Every combination of the values is exported, with the values appended to "
+		"the name of its export. The audio is decoded once and transformed once for each "
+		"combination of DFT window duration and sample interval, and the smoothing "
+		"variants of each transform are generated concurrently."
+
+		"\n\n---"
+
+		"\n\nTo serve requests from other programs, enter: 'serve', optionally followed by "
+		"the path of the Unix domain socket to listen on ('resonance.sock' by default). "
+		"Each request and response is its length in bytes as a 32-bit little-endian "
+		"integer followed by its text. The requests are the 'configure', 'set', and "
+		"'export' commands, 'generate <file name>', which generates the model without "
+		"exporting it, and 'stop', which stops the server. The responses are 'OK' or the "
+		"error. Each connection has its own configuration, starting from the current one, "
+		"and connections are handled concurrently. The decoded audio, DFT data, and meshes "
+		"are kept in memory between requests, so repeated requests for the same audio "
+		"file are much faster."
+
 		"\n\n---"
 		
 		"\n\nTo exit, enter 'exit'."
@@ -95,29 +169,12 @@ void print_startup_message()
 }
 
 
-void validate_command_parameters(const std::string& command, int required, size_t given)
-{
-	if(given != required) throw std::runtime_error{"'"+command+"' requires "
-		+std::to_string(required)+(required == 1 ? " parameter" : " parameters")+
-		" but "+(given > 0 ? "only " : "")+std::to_string(given)+
-		(given == 1 ? " was" : " were")+" given."};
-}
-
-
-void validate_name(const std::string& name)
-{
-	if(!std::regex_match(name, std::regex{"^[a-zA-Z0-9-.]+.(flac|wav|mp3)$"}))
-		throw std::runtime_error{"Invalid audio file name. The file name must "
-			"consist only of alphanumeric characters, dashes, and periods, and be "
-			"either FLAC, WAV, or MP3."};
-}
-
-
 int main(int arguments_count, const char* arguments[])
 {
 	// Initialize.
 	LV::Utilities::platform_initialization(arguments[0]);
 	print_startup_message();
+	LV::Generator generator;
 
 	while(true)
 	{
@@ -138,24 +195,67 @@ int main(int arguments_count, const char* arguments[])
 			// Parse and execute the command.
 			if(command_name == "configure")
 			{
-				validate_command_parameters(command_name, 6, tokens.size());
-				LV::Generator::configure(std::stof(tokens[0]), std::stof(tokens[1]),
+				LV::Utilities::validate_command_parameters(command_name, 6, tokens.size());
+				generator.configure(std::stof(tokens[0]), std::stof(tokens[1]),
 					std::stof(tokens[2]), std::stof(tokens[3]), std::stof(tokens[4]),
 					tokens[5]);
 			}
 
+			else if(command_name == "set")
+			{
+				LV::Utilities::validate_command_parameters(command_name, 2, tokens.size());
+				generator.set_option(tokens[0], tokens[1]);
+			}
+
 			else if(command_name == "view")
 			{
-				validate_command_parameters(command_name, 1, tokens.size());
-				validate_name(tokens[0]);
-				LV::Viewer::view(tokens[0]);
+				LV::Utilities::validate_command_parameters(command_name,
+					1, 3, tokens.size());
+				LV::Utilities::validate_audio_file_name(tokens[0]);
+				const auto [start, end]{LV::Utilities::parse_range(tokens, 1)};
+				LV::Viewer::view(&generator, tokens[0], start, end);
 			}
 
 			else if(command_name == "export")
 			{
-				validate_command_parameters(command_name, 3, tokens.size());
-				validate_name(tokens[0]);
-				LV::Exporter::export_model(tokens[0], tokens[1], tokens[2]);
+				LV::Utilities::validate_command_parameters(command_name,
+					3, 5, tokens.size());
+				LV::Utilities::validate_audio_file_name(tokens[0]);
+				const auto [start, end]{LV::Utilities::parse_range(tokens, 3)};
+				LV::Exporter::export_model(&generator,
+					tokens[0], tokens[1], tokens[2], start, end);
+			}
+
+			else if(command_name == "batch")
+			{
+				LV::Utilities::validate_command_parameters(command_name, 3, tokens.size());
+				LV::Batch::run(generator.get_configuration(),
+					tokens[0], tokens[1], tokens[2]);
+			}
+
+			else if(command_name == "sweep")
+			{
+				LV::Utilities::validate_command_parameters(command_name, 9, tokens.size());
+				LV::Utilities::validate_audio_file_name(tokens[0]);
+				LV::Sweep::run(generator.get_configuration(), tokens[0], tokens[1],
+					tokens[2], {tokens.begin()+3, tokens.end()});
+			}
+
+			else if(command_name == "serve")
+			{
+				LV::Utilities::validate_command_parameters(command_name,
+					0, 1, tokens.size());
+
+				LV::Server::serve(generator.get_configuration(), tokens.empty() ?
+					LV::Constants::default_socket_path : tokens[0]);
+			}
+
+			else if(command_name == "benchmark")
+			{
+				LV::Utilities::validate_command_parameters(command_name,
+					0, 1, tokens.size());
+				const int sample_rate{tokens.empty() ? 44100 : std::stoi(tokens[0])};
+				LV::STFT::benchmark(sample_rate, {10.f, 20.f, 25.f, 30.f, 40.f, 50.f, 100.f});
 			}
 
 			else if(command_name == "exit")
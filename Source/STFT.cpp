@@ -0,0 +1,610 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#include "STFT.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <complex>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <fftw/fftw3.h>
+
+#include "Constants.hpp"
+#include "ThreadPool.hpp"
+#include "Kernels.hpp"
+
+
+namespace
+{
+	constexpr size_t chunk_size{65536}; // Samples.
+	constexpr int chunk_count{4};
+
+	struct Chunk
+	{
+		std::vector<float> samples;
+		size_t size;
+	};
+
+
+	// Passes a fixed set of chunks back and forth between the decoding and transforming
+	// threads, so the samples in flight never exceed chunk_count*chunk_size.
+	struct ChunkQueue
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<Chunk*> free_chunks;
+		std::deque<Chunk*> filled_chunks;
+		bool finished{false};
+		bool aborted{false};
+	};
+
+
+	Chunk* pop(ChunkQueue* queue, std::deque<Chunk*>* chunks)
+	{
+		std::unique_lock<std::mutex> lock{queue->mutex};
+
+		queue->condition.wait(lock, [&]
+		{ return !chunks->empty() || queue->aborted || (queue->finished &&
+			chunks == &queue->filled_chunks); });
+
+		if(chunks->empty() || queue->aborted) return nullptr;
+
+		Chunk* chunk{chunks->front()};
+		chunks->pop_front();
+		return chunk;
+	}
+
+
+	void push(ChunkQueue* queue, std::deque<Chunk*>* chunks, Chunk* chunk)
+	{
+		{
+			std::lock_guard<std::mutex> lock{queue->mutex};
+			chunks->emplace_back(chunk);
+		}
+
+		queue->condition.notify_all();
+	}
+
+
+	void signal(ChunkQueue* queue, bool* flag)
+	{
+		{
+			std::lock_guard<std::mutex> lock{queue->mutex};
+			*flag = true;
+		}
+
+		queue->condition.notify_all();
+	}
+
+
+	constexpr size_t block_frames{16}; // Frames per FFTW call.
+	constexpr size_t batch_memory{1 << 24}; // Bytes of windowed input per batch.
+	constexpr size_t stride_alignment{16}; // Floats, keeping every frame 64-byte aligned.
+	constexpr double benchmark_duration{200000.}; // Microseconds per transform size.
+
+
+	float get_hann_multiplier(int x, int maximum)
+	{ return .5f*(1.f-std::cos(2.f*3.1415926f*x/(maximum))); }
+
+
+	size_t align_stride(size_t size)
+	{ return (size+stride_alignment-1)/stride_alignment*stride_alignment; }
+
+
+	// Returns the number of frames in each batch, a whole number of blocks.
+	size_t get_batch_capacity(size_t input_stride)
+	{
+		return std::max(batch_memory/(input_stride*sizeof(float))/
+			block_frames*block_frames, block_frames);
+	}
+
+
+	struct Plans
+	{
+		fftwf_plan block;
+		fftwf_plan frame;
+	};
+
+
+	// The plans for each transform size, kept for the life of the process. The FFTW planner
+	// is not thread-safe, so planning and wisdom access happen under the mutex.
+	struct PlanCache
+	{
+		std::mutex mutex;
+		std::map<int, Plans> plans;
+		bool wisdom_imported{false};
+
+		~PlanCache();
+	};
+
+
+	PlanCache::~PlanCache()
+	{
+		for(const std::pair<const int, Plans>& entry : plans)
+		{
+			fftwf_destroy_plan(entry.second.block);
+			fftwf_destroy_plan(entry.second.frame);
+		}
+	}
+
+
+	PlanCache& get_plan_cache()
+	{
+		static PlanCache cache;
+		return cache;
+	}
+
+
+	// Returns the plans for the given transform size, planning them on the given buffers if
+	// they are not cached. Any new wisdom is saved so later runs can skip the measurement.
+	Plans get_plans(int transform_size, float* input, fftwf_complex* output,
+		size_t input_stride, size_t output_stride)
+	{
+		PlanCache& cache{get_plan_cache()};
+		std::lock_guard<std::mutex> lock{cache.mutex};
+
+		const auto iterator{cache.plans.find(transform_size)};
+		if(iterator != cache.plans.end()) return iterator->second;
+
+		if(!cache.wisdom_imported)
+		{
+			fftwf_import_wisdom_from_filename(LV::Constants::fftw_wisdom_path.c_str());
+			cache.wisdom_imported = true;
+		}
+
+		const int input_distance{static_cast<int>(input_stride)};
+		const int output_distance{static_cast<int>(output_stride)};
+
+		Plans plans;
+		plans.block = fftwf_plan_many_dft_r2c(1, &transform_size, static_cast<int>(block_frames),
+			input, nullptr, 1, input_distance, output, nullptr, 1, output_distance, FFTW_MEASURE);
+
+		plans.frame = fftwf_plan_dft_r2c_1d(transform_size, input, output, FFTW_MEASURE);
+
+		if(!plans.block || !plans.frame)
+		{
+			if(plans.block) fftwf_destroy_plan(plans.block);
+			if(plans.frame) fftwf_destroy_plan(plans.frame);
+			throw std::runtime_error{"Could not plan the DFT."};
+		}
+
+		cache.plans.emplace(transform_size, plans);
+
+		std::error_code error;
+		std::filesystem::create_directory(std::filesystem::path{
+			LV::Constants::fftw_wisdom_path}.parent_path(), error);
+
+		fftwf_export_wisdom_to_filename(LV::Constants::fftw_wisdom_path.c_str());
+		return plans;
+	}
+
+
+	// Frames gathered from the ring and transformed together. Each block of block_frames
+	// frames is transformed by one call to a batched plan. Since every frame starts at an
+	// aligned offset, the cached plans can be executed on any block, from any thread.
+	struct Batch
+	{
+		size_t input_stride; // Floats.
+		size_t output_stride; // Complex values.
+		size_t capacity; // Frames.
+		size_t size{}; // Frames.
+		float* input{nullptr};
+		fftwf_complex* output{nullptr};
+		Plans plans;
+		std::vector<float> window;
+		std::vector<int> band_edges; // Bins. Empty if the frequencies are not banded.
+
+		Batch(int window_size, int transform_size);
+		~Batch();
+		Batch(const Batch&) = delete;
+		Batch& operator=(const Batch&) = delete;
+	};
+
+
+	Batch::Batch(int window_size, int transform_size)
+	{
+		input_stride = align_stride(transform_size);
+		output_stride = align_stride(transform_size/2+1);
+
+		capacity = get_batch_capacity(input_stride);
+
+		input = fftwf_alloc_real(capacity*input_stride);
+		output = fftwf_alloc_complex(capacity*output_stride);
+
+		try
+		{
+			if(!input || !output) throw std::runtime_error{"Could not allocate the DFT buffers."};
+			plans = get_plans(transform_size, input, output, input_stride, output_stride);
+		}
+		catch(...)
+		{
+			fftwf_free(input);
+			fftwf_free(output);
+			throw;
+		}
+
+		// Only the window is written to each frame, so any zero padding after it is
+		// cleared once here. Planning may have overwritten the buffer.
+		std::fill_n(input, capacity*input_stride, 0.f);
+
+		// Tabulate the Hann window.
+		window.resize(window_size);
+		for(int offset{}; offset < window_size; ++offset)
+			window[offset] = get_hann_multiplier(offset, window_size);
+	}
+
+
+	Batch::~Batch()
+	{
+		fftwf_free(input);
+		fftwf_free(output);
+	}
+
+
+	// Returns the first bin of each band followed by the end of the last band. The bands
+	// are evenly spaced on the band scale between the first bin and the maximum
+	// frequency, except that each band spans at least one bin, so the lowest bands may be
+	// linear.
+	std::vector<int> get_band_edges(const LV::STFT::Settings& settings)
+	{
+		const int transform_size{LV::STFT::get_transform_size(settings)};
+		const int maximum_frequency{transform_size/2-1};
+		const int band_count{LV::STFT::get_column_count(settings)};
+
+		const auto get_mel{[](double frequency){ return 2595.*std::log10(1.+frequency/700.); }};
+		const double bin_frequency{settings.sample_rate/static_cast<double>(transform_size)};
+		const double maximum_mel{get_mel(maximum_frequency*bin_frequency)};
+
+		std::vector<int> edges(band_count+1);
+		edges[band_count] = maximum_frequency;
+
+		for(int band{1}; band < band_count; ++band)
+		{
+			const double position{band/static_cast<double>(band_count)};
+			double bin;
+
+			if(settings.band_scale == LV::STFT::BandScale::log)
+				bin = std::pow(static_cast<double>(maximum_frequency), position);
+
+			else bin = 700.*(std::pow(10., position*maximum_mel/2595.)-1.)/bin_frequency;
+
+			// Keep at least one bin in this band and in each band after it.
+			edges[band] = std::clamp(static_cast<int>(std::lround(bin)),
+				edges[band-1]+1, maximum_frequency-(band_count-band));
+		}
+
+		return edges;
+	}
+
+
+	// Windows and transforms the batched frames in parallel, writing each frame's decibels
+	// to its own row appended to the output.
+	void transform_batch(Batch* batch, const LV::STFT::Settings& settings,
+		LV::Spectrogram* output)
+	{
+		const size_t window_size{static_cast<size_t>(settings.window_size)};
+		const int column_count{LV::STFT::get_column_count(settings)};
+		const size_t first_row{output->append_rows(batch->size)};
+
+		const size_t block_count{(batch->size+block_frames-1)/block_frames};
+		const bool quantized{output->get_format() != LV::Spectrogram::Format::float32};
+
+		LV::ThreadPool::parallel_for(block_count, 1, [&](size_t begin, size_t end)
+		{
+			std::vector<float> scratch(quantized ? column_count : 0);
+
+			for(size_t block{begin}; block < end; ++block)
+			{
+				const size_t first_frame{block*block_frames};
+				const size_t frame_count{std::min(block_frames, batch->size-first_frame)};
+				float* input{batch->input+first_frame*batch->input_stride};
+				fftwf_complex* block_output{batch->output+first_frame*batch->output_stride};
+
+				// Apply the Hann window.
+				for(size_t frame{}; frame < frame_count; ++frame) LV::Kernels::multiply(
+					input+frame*batch->input_stride, batch->window.data(), window_size);
+
+				// Execute the fast Fourier transforms.
+				if(frame_count == block_frames)
+					fftwf_execute_dft_r2c(batch->plans.block, input, block_output);
+
+				else for(size_t frame{}; frame < frame_count; ++frame)
+					fftwf_execute_dft_r2c(batch->plans.frame, input+frame*batch->input_stride,
+						block_output+frame*batch->output_stride);
+
+				// Convert the complex DFT data to decibels and save it. Quantized output is
+				// converted through a scratch row.
+				for(size_t frame{}; frame < frame_count; ++frame)
+				{
+					const size_t row{first_row+first_frame+frame};
+					float* decibels{quantized ? scratch.data() : output->get_row(row)};
+
+					const std::complex<float>* bins{reinterpret_cast<std::complex<float>*>(
+						block_output+frame*batch->output_stride)};
+
+					const float offset{static_cast<float>(LV::Constants::dft_noise_floor)};
+
+					if(batch->band_edges.empty())
+						LV::Kernels::power_to_decibels(bins, decibels, column_count, offset);
+
+					else LV::Kernels::band_power_to_decibels(bins,
+						batch->band_edges.data(), decibels, column_count, offset);
+
+					if(quantized) output->store(row, 0, column_count, decibels);
+				}
+			}
+		});
+
+		batch->size = 0;
+	}
+
+
+	// Consumes the filled chunks through a ring buffer of window_size+hop_size samples,
+	// copying each full window into the batch, which is transformed whenever it fills.
+	void transform_chunks(ChunkQueue* queue, const LV::STFT::Settings& settings,
+		LV::Spectrogram* output)
+	{
+		// Initialize.
+		const size_t window_size{static_cast<size_t>(settings.window_size)};
+		const size_t hop_size{static_cast<size_t>(settings.hop_size)};
+
+		// A frame also requires the sample following its window, so the ring must hold
+		// window_size+1 samples. Since the hop is at least one sample, this always fits.
+		const size_t ring_size{window_size+hop_size};
+		const size_t frame_size{window_size+1};
+		std::vector<float> ring(ring_size);
+		size_t ring_start{};
+		size_t buffered{};
+		size_t skipped{};
+
+		Batch batch{settings.window_size, LV::STFT::get_transform_size(settings)};
+		if(settings.band_count > 0) batch.band_edges = get_band_edges(settings);
+
+		// For each chunk...
+		while(Chunk* chunk{pop(queue, &queue->filled_chunks)})
+		{
+			size_t index{};
+
+			while(index < chunk->size)
+			{
+				// If the hop is longer than the window, skip the samples between frames.
+				if(skipped > 0)
+				{
+					const size_t count{std::min(skipped, chunk->size-index)};
+					index += count;
+					skipped -= count;
+					continue;
+				}
+
+				// Append the samples needed to complete the next frame to the ring.
+				const size_t count{std::min(frame_size-buffered, chunk->size-index)};
+				const size_t write_position{(ring_start+buffered)%ring_size};
+				const size_t first_count{std::min(count, ring_size-write_position)};
+
+				std::copy_n(chunk->samples.begin()+index, first_count,
+					ring.begin()+write_position);
+
+				std::copy_n(chunk->samples.begin()+index+first_count,
+					count-first_count, ring.begin());
+
+				index += count;
+				buffered += count;
+				if(buffered < frame_size) continue;
+
+				// Copy the window into the batch.
+				float* frame{batch.input+batch.size*batch.input_stride};
+				const size_t first_window_count{std::min(window_size, ring_size-ring_start)};
+				std::copy_n(ring.begin()+ring_start, first_window_count, frame);
+				std::copy_n(ring.begin(), window_size-first_window_count, frame+first_window_count);
+
+				if(++batch.size == batch.capacity) transform_batch(&batch, settings, output);
+
+				// Advance the ring by the hop.
+				if(hop_size <= buffered)
+				{
+					ring_start = (ring_start+hop_size)%ring_size;
+					buffered -= hop_size;
+				}
+
+				else
+				{
+					skipped = hop_size-buffered;
+					ring_start = (ring_start+buffered)%ring_size;
+					buffered = 0;
+				}
+			}
+
+			push(queue, &queue->free_chunks, chunk);
+		}
+
+		// Transform the remaining frames.
+		if(batch.size > 0) transform_batch(&batch, settings, output);
+	}
+
+
+	// Returns the average time in microseconds to transform one frame of the given size.
+	double time_transform(int transform_size)
+	{
+		Batch batch{transform_size, transform_size};
+
+		std::mt19937 generator{static_cast<unsigned>(transform_size)};
+		std::uniform_real_distribution<float> distribution{-1.f, 1.f};
+		for(size_t index{}; index < block_frames*batch.input_stride; ++index)
+			batch.input[index] = distribution(generator);
+
+		// Transform blocks until enough time has passed for a stable average.
+		const auto start{std::chrono::steady_clock::now()};
+		std::chrono::duration<double, std::micro> elapsed{};
+		size_t frame_count{};
+
+		while(elapsed.count() < benchmark_duration)
+		{
+			fftwf_execute_dft_r2c(batch.plans.block, batch.input, batch.output);
+			frame_count += block_frames;
+			elapsed = std::chrono::steady_clock::now()-start;
+		}
+
+		return elapsed.count()/frame_count;
+	}
+}
+
+
+// Runs a short-time Fourier transform over the samples pulled from the source. The
+// source is read on the calling thread while the frames are gathered on another
+// thread and transformed in batches on the thread pool.
+void LV::STFT::transform(const Source& source, const Settings& settings,
+	Spectrogram* output, size_t estimated_sample_count)
+{
+	if(settings.window_size < 2 || settings.hop_size < 1) throw std::runtime_error{
+		"The DFT window and sample interval must each span at least one sample."};
+
+	if(settings.band_count > 0 && settings.band_scale == BandScale::mel &&
+		settings.sample_rate <= 0) throw std::runtime_error{
+		"The mel band scale requires the sample rate."};
+
+	output->reset(0, get_column_count(settings));
+	if(estimated_sample_count > 0)
+		output->reserve(estimated_sample_count/settings.hop_size);
+
+	// Allocate the chunks.
+	ChunkQueue queue;
+	std::vector<Chunk> chunks(chunk_count);
+	for(Chunk& chunk : chunks)
+	{
+		chunk.samples.resize(chunk_size);
+		queue.free_chunks.emplace_back(&chunk);
+	}
+
+	// Start the transforming thread.
+	std::exception_ptr transform_exception;
+
+	std::thread transform_thread{[&]
+	{
+		try{ transform_chunks(&queue, settings, output); }
+		catch(...)
+		{
+			transform_exception = std::current_exception();
+			signal(&queue, &queue.aborted);
+		}
+	}};
+
+	// Fill chunks from the source until it is exhausted.
+	try
+	{
+		while(Chunk* chunk{pop(&queue, &queue.free_chunks)})
+		{
+			chunk->size = source(chunk->samples.data(), chunk_size);
+			if(chunk->size > 0) push(&queue, &queue.filled_chunks, chunk);
+			if(chunk->size < chunk_size) break;
+		}
+
+		signal(&queue, &queue.finished);
+	}
+	catch(...)
+	{
+		signal(&queue, &queue.aborted);
+		transform_thread.join();
+		throw;
+	}
+
+	transform_thread.join();
+	if(transform_exception) std::rethrow_exception(transform_exception);
+}
+
+
+// Prints a table comparing the time to transform one frame of each window duration at
+// its own size and zero-padded to the next fast size. Planning is excluded.
+void LV::STFT::benchmark(int sample_rate, const std::vector<float>& window_durations)
+{
+	if(sample_rate < 1000 || sample_rate > 192000) throw std::runtime_error{
+		"The benchmark sample rate must be between 1000 and 192000 hertz."};
+
+	const auto format{[](double value, const std::string& unit)
+	{
+		std::ostringstream stream;
+		stream<<std::fixed<<std::setprecision(2)<<value<<unit;
+		return stream.str();
+	}};
+
+	std::cout<<"Benchmarking at "<<sample_rate<<" Hz...\n\n"<<std::left<<
+		std::setw(10)<<"Window"<<std::setw(10)<<"Samples"<<std::setw(12)<<"Time"<<
+		std::setw(10)<<"Padded"<<std::setw(12)<<"Time"<<"Speedup\n";
+
+	for(const float window_duration : window_durations)
+	{
+		const int window_size{static_cast<int>(sample_rate*(window_duration/1000.f))};
+		if(window_size < 2) continue;
+
+		const int fast_size{get_fast_size(window_size)};
+		const double time{time_transform(window_size)};
+		const double padded_time{fast_size == window_size ? time : time_transform(fast_size)};
+
+		std::cout<<std::setw(10)<<format(window_duration, " ms")<<std::setw(10)<<
+			window_size<<std::setw(12)<<format(time, " us")<<std::setw(10)<<fast_size<<
+			std::setw(12)<<format(padded_time, " us")<<format(time/padded_time, "x")<<'\n';
+	}
+}
+
+
+// Returns the smallest size of the form 2^a*3^b*5^c that is at least the given size.
+// FFTW is fastest for sizes with only small prime factors.
+int LV::STFT::get_fast_size(int size)
+{
+	for(int candidate{std::max(size, 1)};; ++candidate)
+	{
+		int remainder{candidate};
+		for(const int factor : {2, 3, 5}) while(remainder%factor == 0) remainder /= factor;
+		if(remainder == 1) return candidate;
+	}
+}
+
+
+int LV::STFT::get_transform_size(const Settings& settings)
+{ return std::max(settings.fft_size, settings.window_size); }
+
+
+// Returns the bytes used by a transform's buffers, which do not depend on the length of
+// the audio.
+size_t LV::STFT::get_buffer_memory(const Settings& settings)
+{
+	const size_t transform_size{static_cast<size_t>(get_transform_size(settings))};
+	const size_t input_stride{align_stride(transform_size)};
+	const size_t output_stride{align_stride(transform_size/2+1)};
+	const size_t capacity{get_batch_capacity(input_stride)};
+
+	return capacity*(input_stride*sizeof(float)+output_stride*sizeof(fftwf_complex))+
+		settings.window_size*sizeof(float)+chunk_count*chunk_size*sizeof(float);
+}
+
+
+// Returns the number of values in each DFT. There can be no more bands than frequencies.
+int LV::STFT::get_column_count(const Settings& settings)
+{
+	const int maximum_frequency{get_transform_size(settings)/2-1};
+	return settings.band_count > 0 ? std::min(settings.band_count, maximum_frequency) :
+		maximum_frequency;
+}
+
+
+LV::STFT::BandScale LV::STFT::get_band_scale(const std::string& name)
+{
+	if(name == "log") return BandScale::log;
+	if(name == "mel") return BandScale::mel;
+
+	throw std::runtime_error{"The band scale must be either \"log\" or \"mel\"."};
+}
@@ -0,0 +1,54 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "Spectrogram.hpp"
+
+
+namespace LV::STFT
+{
+	enum class BandScale{log, mel};
+
+	struct Settings
+	{
+		int window_size; // Samples.
+		int hop_size; // Samples.
+		int fft_size{}; // Samples. Windows are zero-padded to this size if it is larger.
+
+		// If nonzero, the frequencies are averaged into this many bands, spaced on the
+		// band scale, instead of each being kept. The mel scale requires the sample rate.
+		int band_count{};
+		BandScale band_scale{BandScale::log};
+		int sample_rate{}; // Hertz.
+	};
+
+	// Writes up to the given number of samples to the destination and returns the number
+	// written. Returning less than the requested count signals the end of the samples.
+	using Source = std::function<size_t(float* destination, size_t count)>;
+
+
+	void transform(const Source& source, const Settings& settings,
+		Spectrogram* output, size_t estimated_sample_count = 0);
+
+	void benchmark(int sample_rate, const std::vector<float>& window_durations);
+
+	// Getters.
+	int get_fast_size(int size);
+
+	int get_transform_size(const Settings& settings);
+
+	int get_column_count(const Settings& settings);
+
+	size_t get_buffer_memory(const Settings& settings);
+
+	BandScale get_band_scale(const std::string& name);
+}
@@ -0,0 +1,477 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#include "Server.hpp"
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <system_error>
+#include <chrono>
+#include <cerrno>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <WinSock2.h>
+#include <afunix.h>
+#else
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "Constants.hpp"
+#include "Utilities.hpp"
+#include "Generator.hpp"
+#include "Exporter.hpp"
+#include "ThreadPool.hpp"
+
+
+namespace
+{
+	#ifdef _WIN32
+	using Socket = SOCKET;
+	const Socket invalid_socket{INVALID_SOCKET};
+	void close_socket(Socket socket){ closesocket(socket); }
+	#else
+	using Socket = int;
+	const Socket invalid_socket{-1};
+	void close_socket(Socket socket){ close(socket); }
+	#endif
+
+	constexpr std::chrono::milliseconds accept_retry_delay{100};
+
+
+	int get_socket_error()
+	{
+		#ifdef _WIN32
+		return WSAGetLastError();
+		#else
+		return errno;
+		#endif
+	}
+
+
+	// Whether accept failed because of the connection rather than the listener.
+	bool is_connection_error(int error)
+	{
+		#ifdef _WIN32
+		return error == WSAEINTR || error == WSAECONNRESET;
+		#else
+		return error == EINTR || error == ECONNABORTED;
+		#endif
+	}
+
+
+	// Whether accept failed because the process or system is out of resources, which
+	// closing other connections may free.
+	bool is_resource_error(int error)
+	{
+		#ifdef _WIN32
+		return error == WSAEMFILE || error == WSAENOBUFS;
+		#else
+		return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+		#endif
+	}
+
+
+	// Writing to a closed connection must fail rather than raise SIGPIPE.
+	#ifdef MSG_NOSIGNAL
+	constexpr int send_flags{MSG_NOSIGNAL};
+	#else
+	constexpr int send_flags{0};
+	#endif
+
+
+	// An idle generator and the audio file it last generated, which it keeps memoized.
+	struct PooledGenerator
+	{
+		std::unique_ptr<LV::Generator> generator;
+		std::string file_name;
+		size_t memory{}; // Bytes.
+	};
+
+
+	std::string socket_path;
+	std::atomic<bool> stopping{false};
+
+	// The open connections, each handled by a detached thread that removes its own.
+	std::mutex connections_mutex;
+	std::condition_variable connections_closed;
+	std::vector<Socket> connections;
+
+	// The idle generators, least recently used first.
+	std::mutex generators_mutex;
+	std::vector<PooledGenerator> idle_generators;
+
+
+	bool receive(Socket socket, void* destination, size_t size)
+	{
+		char* position{static_cast<char*>(destination)};
+
+		while(size > 0)
+		{
+			const auto received{recv(socket, position, static_cast<int>(size), 0)};
+			if(received <= 0) return false;
+
+			position += received;
+			size -= received;
+		}
+
+		return true;
+	}
+
+
+	bool send_all(Socket socket, const void* source, size_t size)
+	{
+		const char* position{static_cast<const char*>(source)};
+
+		while(size > 0)
+		{
+			const auto sent{send(socket, position, static_cast<int>(size), send_flags)};
+			if(sent <= 0) return false;
+
+			position += sent;
+			size -= sent;
+		}
+
+		return true;
+	}
+
+
+	// Each message is its length in bytes as a 32-bit little-endian integer followed by
+	// its text. Returns false once the connection is closed.
+	bool read_message(Socket socket, std::string* message)
+	{
+		uint8_t header[4];
+		if(!receive(socket, header, sizeof(header))) return false;
+
+		const uint32_t size{header[0]|(header[1] << 8u)|(header[2] << 16u)|
+			(static_cast<uint32_t>(header[3]) << 24u)};
+
+		if(size > LV::Constants::maximum_request_size) return false;
+
+		message->resize(size);
+		return receive(socket, message->data(), size);
+	}
+
+
+	bool write_message(Socket socket, const std::string& message)
+	{
+		const uint32_t size{static_cast<uint32_t>(message.size())};
+		const uint8_t header[4]{static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8u),
+			static_cast<uint8_t>(size >> 16u), static_cast<uint8_t>(size >> 24u)};
+
+		return send_all(socket, header, sizeof(header)) &&
+			send_all(socket, message.data(), message.size());
+	}
+
+
+	sockaddr_un get_address(const std::string& path)
+	{
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+
+		if(path.size() >= sizeof(address.sun_path))
+			throw std::runtime_error{"The socket path is too long."};
+
+		std::memcpy(address.sun_path, path.c_str(), path.size()+1);
+		return address;
+	}
+
+
+	// Prefers the generator that last generated the same audio file, then the most
+	// recently used one, so repeated requests skip the stages they share.
+	PooledGenerator acquire_generator(const std::string& file_name)
+	{
+		std::lock_guard<std::mutex> lock{generators_mutex};
+
+		auto match{std::find_if(idle_generators.begin(), idle_generators.end(),
+			[&](const PooledGenerator& pooled){ return pooled.file_name == file_name; })};
+
+		if(match == idle_generators.end())
+		{
+			if(idle_generators.empty()) return {std::make_unique<LV::Generator>(), file_name};
+			match = idle_generators.end()-1;
+		}
+
+		PooledGenerator pooled{std::move(*match)};
+		idle_generators.erase(match);
+		pooled.file_name = file_name;
+		return pooled;
+	}
+
+
+	// Returns the generator to the pool, dropping the least recently used generators
+	// beyond one per thread or beyond the server's cache budget. A generator larger
+	// than the whole budget is not kept.
+	void release_generator(PooledGenerator pooled)
+	{
+		pooled.memory = pooled.generator->get_memory_size();
+
+		// Evicted generators are freed after the lock is released.
+		std::vector<PooledGenerator> evicted;
+		std::lock_guard<std::mutex> lock{generators_mutex};
+		idle_generators.emplace_back(std::move(pooled));
+
+		const size_t maximum_count{LV::ThreadPool::get_thread_count()};
+		size_t memory{};
+		for(const PooledGenerator& generator : idle_generators) memory += generator.memory;
+
+		auto kept{idle_generators.begin()};
+		while(kept != idle_generators.end() &&
+			(memory > LV::Constants::server_cache_budget ||
+			static_cast<size_t>(idle_generators.end()-kept) > maximum_count))
+		{
+			memory -= kept->memory;
+			++kept;
+		}
+
+		evicted.assign(std::make_move_iterator(idle_generators.begin()),
+			std::make_move_iterator(kept));
+
+		idle_generators.erase(idle_generators.begin(), kept);
+	}
+
+
+	// Generates the audio file with a pooled generator and the connection's
+	// configuration. Generators that fail are discarded rather than returned.
+	void generate(const LV::GeneratorConfiguration& configuration,
+		const std::vector<std::string>& tokens, const std::string* format = nullptr,
+		const std::string* orientation = nullptr)
+	{
+		LV::Utilities::validate_audio_file_name(tokens[0]);
+		const auto [start, end]{LV::Utilities::parse_range(tokens, format ? 3 : 1)};
+
+		PooledGenerator pooled{acquire_generator(tokens[0])};
+		pooled.generator->set_configuration(configuration);
+
+		if(format) LV::Exporter::export_model(pooled.generator.get(),
+			tokens[0], *format, *orientation, start, end);
+
+		else pooled.generator->generate(tokens[0], start, end);
+
+		release_generator(std::move(pooled));
+	}
+
+
+	// Executes one request and returns the response. Configuration changes only apply
+	// to the connection they were made on.
+	std::string handle_request(const std::string& request, LV::Generator* settings)
+	{
+		std::vector<std::string> tokens{LV::Utilities::split(request)};
+		if(tokens.empty()) throw std::runtime_error{"No command entered."};
+
+		std::string command_name{tokens[0]};
+		tokens.erase(tokens.begin());
+
+		if(command_name == "configure")
+		{
+			LV::Utilities::validate_command_parameters(command_name, 6, tokens.size());
+			settings->configure(std::stof(tokens[0]), std::stof(tokens[1]),
+				std::stof(tokens[2]), std::stof(tokens[3]), std::stof(tokens[4]), tokens[5]);
+		}
+
+		else if(command_name == "set")
+		{
+			LV::Utilities::validate_command_parameters(command_name, 2, tokens.size());
+			settings->set_option(tokens[0], tokens[1]);
+		}
+
+		else if(command_name == "generate")
+		{
+			LV::Utilities::validate_command_parameters(command_name, 1, 3, tokens.size());
+			generate(settings->get_configuration(), tokens);
+		}
+
+		else if(command_name == "export")
+		{
+			LV::Utilities::validate_command_parameters(command_name, 3, 5, tokens.size());
+			LV::Exporter::validate_options(tokens[1], tokens[2]);
+			generate(settings->get_configuration(), tokens, &tokens[1], &tokens[2]);
+		}
+
+		else if(command_name == "stop")
+		{
+			LV::Utilities::validate_command_parameters(command_name, 0, tokens.size());
+			stopping = true;
+		}
+
+		else throw std::runtime_error{"Unrecognized command."};
+
+		return "OK";
+	}
+
+
+	void serve_connection(Socket socket, const LV::GeneratorConfiguration& configuration)
+	{
+		LV::Generator settings{configuration};
+		std::string request;
+
+		while(!stopping && read_message(socket, &request))
+		{
+			std::string response;
+
+			try { response = handle_request(request, &settings); }
+			catch(std::exception& error){ response = std::string{"ERROR: "}+error.what(); }
+			catch(...){ response = "ERROR: Unhandled exception."; }
+
+			if(!write_message(socket, response)) break;
+
+			// Wake the listener, which is blocked accepting the next connection.
+			if(stopping)
+			{
+				const Socket wake{::socket(AF_UNIX, SOCK_STREAM, 0)};
+				const sockaddr_un address{get_address(socket_path)};
+
+				if(wake != invalid_socket)
+				{
+					connect(wake, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+					close_socket(wake);
+				}
+			}
+		}
+	}
+
+
+	void close_connection(Socket socket)
+	{
+		std::lock_guard<std::mutex> lock{connections_mutex};
+		connections.erase(std::remove(connections.begin(), connections.end(), socket),
+			connections.end());
+
+		close_socket(socket);
+		connections_closed.notify_all();
+	}
+
+
+	// Closing the connection is the last thing the thread does, so the server can stop
+	// once every connection is closed.
+	void handle_connection(Socket socket, LV::GeneratorConfiguration configuration)
+	{
+		try{ serve_connection(socket, configuration); }
+		catch(...){}
+
+		close_connection(socket);
+	}
+}
+
+
+// Serves requests over a Unix domain socket until a 'stop' request. Each connection is
+// handled on its own thread, and the generators are kept between requests, along with
+// the FFT plans and the caches, so repeated requests skip the work they share.
+void LV::Server::serve(const GeneratorConfiguration& configuration,
+	const std::string& socket_path)
+{
+	#ifdef _WIN32
+	WSADATA data;
+	if(WSAStartup(MAKEWORD(2, 2), &data) != 0)
+		throw std::runtime_error{"Failed to initialize Winsock."};
+	#endif
+
+	// Listen.
+	::socket_path = socket_path;
+	stopping = false;
+
+	const sockaddr_un address{get_address(socket_path)};
+	std::filesystem::remove(socket_path);
+
+	const Socket listener{socket(AF_UNIX, SOCK_STREAM, 0)};
+	if(listener == invalid_socket) throw std::runtime_error{"Failed to create the socket."};
+
+	if(bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+		listen(listener, SOMAXCONN) != 0)
+	{
+		close_socket(listener);
+		throw std::runtime_error{"Failed to listen on \""+socket_path+"\"."};
+	}
+
+	std::cout<<"Listening on \""<<socket_path<<"\". Send 'stop' to stop the server.\n";
+
+	// Accept connections until stopped.
+	while(!stopping)
+	{
+		const Socket connection{accept(listener, nullptr, nullptr)};
+
+		if(connection == invalid_socket)
+		{
+			const int error{get_socket_error()};
+			if(is_connection_error(error)) continue;
+
+			if(is_resource_error(error))
+			{
+				std::this_thread::sleep_for(accept_retry_delay);
+				continue;
+			}
+
+			std::cout<<"ERROR: Failed to accept a connection: "<<
+				std::system_category().message(error)<<'\n';
+
+			stopping = true;
+			break;
+		}
+
+		#ifdef SO_NOSIGPIPE
+		const int enabled{1};
+		setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+		#endif
+
+		{
+			std::lock_guard<std::mutex> lock{connections_mutex};
+
+			if(stopping)
+			{
+				close_socket(connection);
+				break;
+			}
+
+			connections.push_back(connection);
+		}
+
+		// Refuse the connection if its thread cannot be started.
+		try{ std::thread{handle_connection, connection, configuration}.detach(); }
+		catch(std::system_error& error)
+		{
+			std::cout<<"ERROR: "<<error.what()<<'\n';
+			close_connection(connection);
+		}
+	}
+
+	// Disconnect the remaining clients and wait for their requests to finish.
+	close_socket(listener);
+
+	{
+		std::unique_lock<std::mutex> lock{connections_mutex};
+		for(const Socket connection : connections)
+			#ifdef _WIN32
+			shutdown(connection, SD_BOTH);
+			#else
+			shutdown(connection, SHUT_RDWR);
+			#endif
+
+		connections_closed.wait(lock, []{ return connections.empty(); });
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{generators_mutex};
+		idle_generators.clear();
+	}
+
+	std::filesystem::remove(socket_path);
+
+	#ifdef _WIN32
+	WSACleanup();
+	#endif
+
+	std::cout<<"Server stopped.\n";
+}
@@ -0,0 +1,452 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#include "Smoothing.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <atomic>
+
+#include "ThreadPool.hpp"
+
+
+namespace
+{
+	constexpr double pi{3.14159265358979323846};
+	constexpr double gaussian_tail{4.}; // Standard deviations.
+	constexpr size_t row_grain_size{64}; // Rows per task.
+	constexpr size_t strip_memory{1 << 23}; // Bytes per column strip.
+	constexpr size_t maximum_strip_width{16}; // Columns, one cache line of each row.
+
+	// Precomputed values for one kernel and radius, shared by every line.
+	struct Filter
+	{
+		LV::Smoothing::Kernel kernel{LV::Smoothing::Kernel::box};
+		int radius{};
+
+		// Hann. The phase e^(i*pi*t/(radius+1)) of each sample index over one period.
+		std::vector<std::complex<double>> phases;
+
+		// Gaussian. The recursion coefficients, already divided by b0, and the number of
+		// zeros past the end of each line over which the causal response is carried.
+		double gain{};
+		double feedback[3]{};
+		size_t tail{};
+	};
+
+	// Scratch memory reused across lines. Sums are prefix sums, so sums[i] covers the
+	// samples before index i.
+	struct Workspace
+	{
+		std::vector<double> line;
+		std::vector<double> sums;
+		std::vector<std::complex<double>> modulated_sums;
+		std::vector<std::complex<double>> phase_sums;
+		std::vector<double> forward;
+		std::vector<double> weights;
+	};
+
+
+	// Computes the third order recursive Gaussian coefficients of Young and van Vliet.
+	// The radius spans two standard deviations.
+	void initialize_gaussian(Filter* filter)
+	{
+		const double sigma{std::max(filter->radius/2., .5)};
+
+		const double q{sigma >= 2.5 ? .98711*sigma-.96330 :
+			3.97156-4.14554*std::sqrt(1.-.26891*sigma)};
+
+		const double b0{1.57825+2.44413*q+1.4281*q*q+.422205*q*q*q};
+		const double b1{2.44413*q+2.85619*q*q+1.26661*q*q*q};
+		const double b2{-(1.4281*q*q+1.26661*q*q*q)};
+		const double b3{.422205*q*q*q};
+
+		filter->gain = 1.-(b1+b2+b3)/b0;
+		filter->feedback[0] = b1/b0;
+		filter->feedback[1] = b2/b0;
+		filter->feedback[2] = b3/b0;
+		filter->tail = static_cast<size_t>(std::ceil(gaussian_tail*sigma));
+	}
+
+
+	Filter create_filter(LV::Smoothing::Kernel kernel, int radius)
+	{
+		Filter filter;
+		filter.kernel = kernel;
+		filter.radius = radius;
+
+		if(kernel == LV::Smoothing::Kernel::hann)
+		{
+			const int period{2*(radius+1)};
+			filter.phases.resize(period);
+
+			for(int index{}; index < period; ++index)
+				filter.phases[index] = std::polar(1., pi*index/(radius+1));
+		}
+
+		else if(kernel == LV::Smoothing::Kernel::gaussian) initialize_gaussian(&filter);
+		return filter;
+	}
+
+
+	void compute_sums(const double* values, size_t count, std::vector<double>* sums)
+	{
+		sums->resize(count+1);
+		(*sums)[0] = 0.;
+		for(size_t index{}; index < count; ++index) (*sums)[index+1] = (*sums)[index]+values[index];
+	}
+
+
+	// Averages the samples within the radius, dividing by the number of samples in range
+	// plus one, as the original smoothing did.
+	void smooth_box(const Filter& filter, Workspace* workspace,
+		size_t count, float* output)
+	{
+		const size_t radius{static_cast<size_t>(filter.radius)};
+		compute_sums(workspace->line.data(), count, &workspace->sums);
+		const std::vector<double>& sums{workspace->sums};
+
+		for(size_t index{}; index < count; ++index)
+		{
+			const size_t first{index > radius ? index-radius : 0};
+			const size_t last{std::min(index+radius, count-1)};
+
+			output[index] = static_cast<float>(
+				(sums[last+1]-sums[first])/(last-first+2));
+		}
+	}
+
+
+	// Weights the samples within the radius by a Hann window. Since the window is a cosine
+	// plus a constant, its weighted sums follow from running sums of the samples and of the
+	// samples modulated by the cosine's phase. Dividing by the sum of the weights in range
+	// normalizes the edges.
+	void smooth_hann(const Filter& filter, Workspace* workspace,
+		size_t count, float* output)
+	{
+		const double* values{workspace->line.data()};
+		const size_t radius{static_cast<size_t>(filter.radius)};
+		const size_t period{filter.phases.size()};
+
+		compute_sums(values, count, &workspace->sums);
+		workspace->modulated_sums.resize(count+1);
+		workspace->phase_sums.resize(count+1);
+		workspace->modulated_sums[0] = workspace->phase_sums[0] = 0.;
+
+		for(size_t index{}; index < count; ++index)
+		{
+			const std::complex<double> phase{filter.phases[index%period]};
+			workspace->modulated_sums[index+1] = workspace->modulated_sums[index]+values[index]*phase;
+			workspace->phase_sums[index+1] = workspace->phase_sums[index]+phase;
+		}
+
+		for(size_t index{}; index < count; ++index)
+		{
+			const size_t first{index > radius ? index-radius : 0};
+			const size_t last{std::min(index+radius, count-1)};
+			const std::complex<double> rotation{std::conj(filter.phases[index%period])};
+
+			const double sum{.5*(workspace->sums[last+1]-workspace->sums[first])+.5*std::real(
+				rotation*(workspace->modulated_sums[last+1]-workspace->modulated_sums[first]))};
+
+			const double weight{.5*(last-first+1)+.5*std::real(
+				rotation*(workspace->phase_sums[last+1]-workspace->phase_sums[first]))};
+
+			output[index] = static_cast<float>(sum/weight);
+		}
+	}
+
+
+	// Runs the causal and anticausal recursions over the input, treating samples outside
+	// the line as zero. The causal response continues past the end of the line, so it is
+	// carried over a tail of zeros before the anticausal recursion starts.
+	void filter_gaussian(const Filter& filter, const double* input,
+		size_t count, std::vector<double>* forward, double* output)
+	{
+		const double* b{filter.feedback};
+		const size_t extended_count{count+filter.tail};
+		forward->resize(extended_count);
+		double w1{}, w2{}, w3{};
+
+		for(size_t index{}; index < extended_count; ++index)
+		{
+			const double sample{index < count ? input[index] : 0.};
+			const double value{filter.gain*sample+b[0]*w1+b[1]*w2+b[2]*w3};
+			(*forward)[index] = value;
+			w3 = w2; w2 = w1; w1 = value;
+		}
+
+		w1 = w2 = w3 = 0.;
+		for(size_t index{extended_count}; index-- > 0;)
+		{
+			const double value{filter.gain*(*forward)[index]+b[0]*w1+b[1]*w2+b[2]*w3};
+			if(index < count) output[index] = value;
+			w3 = w2; w2 = w1; w1 = value;
+		}
+	}
+
+
+	// Applies a recursive Gaussian, normalizing the edges by the same filter run over
+	// a line of ones.
+	void smooth_gaussian(const Filter& filter, Workspace* workspace,
+		size_t count, float* output)
+	{
+		workspace->weights.assign(count, 1.);
+		filter_gaussian(filter, workspace->weights.data(), count,
+			&workspace->forward, workspace->weights.data());
+
+		filter_gaussian(filter, workspace->line.data(), count,
+			&workspace->forward, workspace->line.data());
+
+		for(size_t index{}; index < count; ++index) output[index] =
+			static_cast<float>(workspace->line[index]/workspace->weights[index]);
+	}
+
+
+	// Smooths the line of count contiguous values in place.
+	void smooth_line(const Filter& filter, Workspace* workspace, float* values, size_t count)
+	{
+		workspace->line.assign(values, values+count);
+
+		switch(filter.kernel)
+		{
+			case LV::Smoothing::Kernel::box:
+				smooth_box(filter, workspace, count, values); break;
+
+			case LV::Smoothing::Kernel::hann:
+				smooth_hann(filter, workspace, count, values); break;
+
+			case LV::Smoothing::Kernel::gaussian:
+				smooth_gaussian(filter, workspace, count, values); break;
+		}
+	}
+
+
+	void update_peak(std::atomic<float>* peak, float value)
+	{
+		float current{peak->load(std::memory_order_relaxed)};
+		while(value > current && !peak->compare_exchange_weak(current, value));
+	}
+
+
+	float get_peak(const float* values, size_t count)
+	{ return count > 0 ? *std::max_element(values, values+count) : 0.f; }
+
+
+	bool is_quantized(const LV::Spectrogram& spectrogram)
+	{ return spectrogram.get_format() != LV::Spectrogram::Format::float32; }
+
+
+	// Smooths each DFT across its frequencies, in parallel blocks of rows. Quantized rows
+	// are smoothed through a float line. Returns the peak of the result.
+	float smooth_rows(LV::Spectrogram* spectrogram, int radius, LV::Smoothing::Kernel kernel)
+	{
+		const Filter filter{create_filter(kernel, radius)};
+		const size_t columns{spectrogram->get_columns()};
+		const bool quantized{is_quantized(*spectrogram)};
+		std::atomic<float> peak{0.f};
+
+		LV::ThreadPool::parallel_for(spectrogram->get_rows(), row_grain_size,
+			[&](size_t begin, size_t end)
+		{
+			Workspace workspace;
+			std::vector<float> line(quantized ? columns : 0);
+			float local_peak{};
+
+			for(size_t row{begin}; row < end; ++row)
+			{
+				float* values{quantized ? line.data() : spectrogram->get_row(row)};
+				if(quantized) spectrogram->load(row, 0, columns, values);
+
+				smooth_line(filter, &workspace, values, columns);
+				local_peak = std::max(local_peak, get_peak(values, columns));
+
+				if(quantized) spectrogram->store(row, 0, columns, values);
+			}
+
+			update_peak(&peak, local_peak);
+		});
+
+		return peak;
+	}
+
+
+	// Smooths each frequency across the DFTs, in parallel strips of adjacent columns. Each
+	// strip is gathered into contiguous lines one row at a time, so every row is read and
+	// written a cache line at a time instead of a value at a time. Returns the peak of the
+	// result.
+	float smooth_columns(LV::Spectrogram* spectrogram, int radius, LV::Smoothing::Kernel kernel)
+	{
+		const Filter filter{create_filter(kernel, radius)};
+		const size_t rows{spectrogram->get_rows()};
+		const size_t columns{spectrogram->get_columns()};
+		if(rows == 0) return 0.f;
+
+		const size_t strip_width{std::clamp(strip_memory/(rows*sizeof(float)),
+			size_t{1}, maximum_strip_width)};
+
+		const size_t strip_count{(columns+strip_width-1)/strip_width};
+		const bool quantized{is_quantized(*spectrogram)};
+		std::atomic<float> peak{0.f};
+
+		LV::ThreadPool::parallel_for(strip_count, 1, [&](size_t begin, size_t end)
+		{
+			Workspace workspace;
+			std::vector<float> strip(strip_width*rows);
+			std::vector<float> segment(quantized ? strip_width : 0);
+			float local_peak{};
+
+			for(size_t strip_index{begin}; strip_index < end; ++strip_index)
+			{
+				const size_t first_column{strip_index*strip_width};
+				const size_t width{std::min(strip_width, columns-first_column)};
+
+				// Gather.
+				for(size_t row{}; row < rows; ++row)
+				{
+					const float* values{quantized ?
+						segment.data() : spectrogram->get_row(row)+first_column};
+
+					if(quantized) spectrogram->load(row, first_column, width, segment.data());
+
+					for(size_t column{}; column < width; ++column)
+						strip[column*rows+row] = values[column];
+				}
+
+				// Smooth.
+				for(size_t column{}; column < width; ++column)
+					smooth_line(filter, &workspace, strip.data()+column*rows, rows);
+
+				// Scatter.
+				for(size_t row{}; row < rows; ++row)
+				{
+					float* values{quantized ?
+						segment.data() : spectrogram->get_row(row)+first_column};
+
+					for(size_t column{}; column < width; ++column)
+					{
+						values[column] = strip[column*rows+row];
+						local_peak = std::max(local_peak, values[column]);
+					}
+
+					if(quantized) spectrogram->store(row, first_column, width, segment.data());
+				}
+			}
+
+			update_peak(&peak, local_peak);
+		});
+
+		return peak;
+	}
+
+
+	// Finds the peak of unsmoothed data.
+	float find_peak(const LV::Spectrogram& spectrogram)
+	{
+		const size_t columns{spectrogram.get_columns()};
+		const bool quantized{is_quantized(spectrogram)};
+		std::atomic<float> peak{0.f};
+
+		LV::ThreadPool::parallel_for(spectrogram.get_rows(), row_grain_size,
+			[&](size_t begin, size_t end)
+		{
+			std::vector<float> line(quantized ? columns : 0);
+			float local_peak{};
+
+			for(size_t row{begin}; row < end; ++row)
+			{
+				const float* values{quantized ? line.data() : spectrogram.get_row(row)};
+				if(quantized) spectrogram.load(row, 0, columns, line.data());
+				local_peak = std::max(local_peak, get_peak(values, columns));
+			}
+
+			update_peak(&peak, local_peak);
+		});
+
+		return peak;
+	}
+}
+
+
+// Applies harmonic smoothing across each DFT's frequencies and then temporal smoothing
+// across the DFTs, in place, returning the peak of the result. The cost does not depend
+// on the radii.
+float LV::Smoothing::smooth(Spectrogram* spectrogram, int harmonic_radius,
+	int temporal_radius, Kernel kernel)
+{
+	if(temporal_radius <= 0) return smooth_harmonics(spectrogram, harmonic_radius, kernel);
+	if(harmonic_radius > 0) smooth_rows(spectrogram, harmonic_radius, kernel);
+	return smooth_columns(spectrogram, temporal_radius, kernel);
+}
+
+
+// Applies only the harmonic smoothing, in place, returning the peak of the result.
+float LV::Smoothing::smooth_harmonics(Spectrogram* spectrogram, int radius, Kernel kernel)
+{ return radius > 0 ? smooth_rows(spectrogram, radius, kernel) : find_peak(*spectrogram); }
+
+
+// Applies only the temporal smoothing, in place, returning the peak of the result.
+float LV::Smoothing::smooth_temporally(Spectrogram* spectrogram, int radius, Kernel kernel)
+{ return radius > 0 ? smooth_columns(spectrogram, radius, kernel) : find_peak(*spectrogram); }
+
+
+// Averages each block of time_factor DFTs by frequency_factor frequencies into one value
+// of the output, which takes the spectrogram's format. Partial blocks at the ends are
+// averaged over the values they contain.
+void LV::Smoothing::downsample(const Spectrogram& spectrogram, Spectrogram* output,
+	size_t time_factor, size_t frequency_factor)
+{
+	const size_t rows{spectrogram.get_rows()};
+	const size_t columns{spectrogram.get_columns()};
+	const size_t output_columns{(columns+frequency_factor-1)/frequency_factor};
+
+	output->set_format(spectrogram.get_format(), spectrogram.get_scale());
+	output->reset((rows+time_factor-1)/time_factor, output_columns);
+
+	ThreadPool::parallel_for(output->get_rows(), row_grain_size, [&](size_t begin, size_t end)
+	{
+		std::vector<float> line(columns);
+		std::vector<float> sums(output_columns);
+
+		for(size_t output_row{begin}; output_row < end; ++output_row)
+		{
+			const size_t first_row{output_row*time_factor};
+			const size_t row_count{std::min(time_factor, rows-first_row)};
+			std::fill(sums.begin(), sums.end(), 0.f);
+
+			for(size_t row{first_row}; row < first_row+row_count; ++row)
+			{
+				spectrogram.load(row, 0, columns, line.data());
+				for(size_t column{}; column < columns; ++column)
+					sums[column/frequency_factor] += line[column];
+			}
+
+			for(size_t column{}; column < output_columns; ++column)
+			{
+				const size_t column_count{std::min(frequency_factor,
+					columns-column*frequency_factor)};
+
+				sums[column] /= static_cast<float>(row_count*column_count);
+			}
+
+			output->store(output_row, 0, output_columns, sums.data());
+		}
+	});
+}
+
+
+LV::Smoothing::Kernel LV::Smoothing::get_kernel(const std::string& name)
+{
+	if(name == "box") return Kernel::box;
+	if(name == "gaussian") return Kernel::gaussian;
+	if(name == "hann") return Kernel::hann;
+
+	throw std::runtime_error{"The smoothing kernel must be \"box\", \"gaussian\", or \"hann\"."};
+}
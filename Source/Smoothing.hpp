@@ -0,0 +1,32 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#pragma once
+
+#include <string>
+
+#include "Spectrogram.hpp"
+
+
+namespace LV::Smoothing
+{
+	enum class Kernel{box, gaussian, hann};
+
+
+	float smooth(Spectrogram* spectrogram, int harmonic_radius, int temporal_radius,
+		Kernel kernel);
+
+	float smooth_harmonics(Spectrogram* spectrogram, int radius, Kernel kernel);
+
+	float smooth_temporally(Spectrogram* spectrogram, int radius, Kernel kernel);
+
+	void downsample(const Spectrogram& spectrogram, Spectrogram* output,
+		size_t time_factor, size_t frequency_factor);
+
+	// Getters.
+	Kernel get_kernel(const std::string& name);
+}
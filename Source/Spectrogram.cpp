@@ -0,0 +1,179 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#include "Spectrogram.hpp"
+
+#include <new>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+
+
+namespace
+{
+	constexpr size_t alignment{64}; // Bytes.
+
+
+	uint8_t* allocate(size_t size)
+	{
+		if(size == 0) return nullptr;
+		return static_cast<uint8_t*>(::operator new(size, std::align_val_t{alignment}));
+	}
+
+
+	void deallocate(uint8_t* data)
+	{ if(data) ::operator delete(data, std::align_val_t{alignment}); }
+}
+
+
+LV::Spectrogram::Spectrogram(size_t rows, size_t columns, Format format, float scale)
+{
+	set_format(format, scale);
+	reset(rows, columns);
+}
+
+
+LV::Spectrogram::~Spectrogram(){ deallocate(data); }
+
+
+LV::Spectrogram::Spectrogram(const Spectrogram& other) :
+	rows{other.rows}, columns{other.columns}, stride{other.stride}, capacity{other.rows},
+	format{other.format}, element_size{other.element_size}, scale{other.scale}
+{
+	data = allocate(capacity*stride*element_size);
+	if(rows > 0) std::memcpy(data, other.data, rows*stride*element_size);
+}
+
+
+LV::Spectrogram& LV::Spectrogram::operator=(const Spectrogram& other)
+{
+	if(this != &other) *this = Spectrogram{other};
+	return *this;
+}
+
+
+LV::Spectrogram::Spectrogram(Spectrogram&& other) noexcept :
+	data{std::exchange(other.data, nullptr)}, rows{std::exchange(other.rows, 0)},
+	columns{std::exchange(other.columns, 0)}, stride{std::exchange(other.stride, 0)},
+	capacity{std::exchange(other.capacity, 0)}, format{other.format},
+	element_size{other.element_size}, scale{other.scale} {}
+
+
+LV::Spectrogram& LV::Spectrogram::operator=(Spectrogram&& other) noexcept
+{
+	std::swap(data, other.data);
+	std::swap(rows, other.rows);
+	std::swap(columns, other.columns);
+	std::swap(stride, other.stride);
+	std::swap(capacity, other.capacity);
+	std::swap(format, other.format);
+	std::swap(element_size, other.element_size);
+	std::swap(scale, other.scale);
+	return *this;
+}
+
+
+// Discards the contents and resizes to the given dimensions, keeping the format. The
+// values are left uninitialized.
+void LV::Spectrogram::reset(size_t rows, size_t columns)
+{
+	clear();
+	this->columns = columns;
+
+	const size_t alignment_elements{alignment/element_size};
+	stride = (columns+alignment_elements-1)/alignment_elements*alignment_elements;
+
+	reserve(rows);
+	this->rows = rows;
+}
+
+
+// Discards the contents and sets the storage format. For the 16-bit format, values are
+// stored as multiples of the scale, so the scale should be the largest expected value
+// divided by 65535. Values outside of that range are clamped.
+void LV::Spectrogram::set_format(Format format, float scale)
+{
+	clear();
+	this->format = format;
+	this->scale = scale;
+	element_size = format == Format::uint16 ? sizeof(uint16_t) : sizeof(float);
+	columns = 0;
+	stride = 0;
+}
+
+
+void LV::Spectrogram::reserve(size_t rows)
+{ if(rows > capacity) reallocate(rows); }
+
+
+// Appends the given number of uninitialized rows and returns the index of the first.
+// Rows are only moved when the capacity grows, never while they are being written.
+size_t LV::Spectrogram::append_rows(size_t count)
+{
+	const size_t first_row{rows};
+	if(rows+count > capacity) reallocate(std::max(rows+count, capacity*2));
+	rows += count;
+	return first_row;
+}
+
+
+void LV::Spectrogram::clear()
+{
+	deallocate(data);
+	data = nullptr;
+	rows = 0;
+	capacity = 0;
+}
+
+
+// Copies count values of the row, starting at the column, to the destination as floats.
+void LV::Spectrogram::load(size_t row, size_t column, size_t count, float* destination) const
+{
+	if(format == Format::float32)
+	{
+		std::memcpy(destination, get_row(row)+column, count*sizeof(float));
+		return;
+	}
+
+	const uint16_t* values{reinterpret_cast<const uint16_t*>(data)+row*stride+column};
+	for(size_t index{}; index < count; ++index) destination[index] = values[index]*scale;
+}
+
+
+// Copies count floats from the source into the row, starting at the column.
+void LV::Spectrogram::store(size_t row, size_t column, size_t count, const float* source)
+{
+	if(format == Format::float32)
+	{
+		std::memcpy(get_row(row)+column, source, count*sizeof(float));
+		return;
+	}
+
+	uint16_t* values{reinterpret_cast<uint16_t*>(data)+row*stride+column};
+	const float inverse_scale{1.f/scale};
+
+	for(size_t index{}; index < count; ++index) values[index] = static_cast<uint16_t>(
+		std::clamp(source[index]*inverse_scale, 0.f, 65535.f)+.5f);
+}
+
+
+float LV::Spectrogram::get(size_t row, size_t column) const
+{
+	if(format == Format::float32) return get_row(row)[column];
+	return reinterpret_cast<const uint16_t*>(data)[row*stride+column]*scale;
+}
+
+
+void LV::Spectrogram::reallocate(size_t capacity)
+{
+	uint8_t* new_data{allocate(capacity*stride*element_size)};
+	if(rows > 0) std::memcpy(new_data, data, rows*stride*element_size);
+	deallocate(data);
+
+	data = new_data;
+	this->capacity = capacity;
+}
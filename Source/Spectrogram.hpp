@@ -0,0 +1,111 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace LV
+{
+	// A strided view of one column of a spectrogram.
+	template<typename T>
+	struct ColumnView
+	{
+		T* data;
+		size_t stride;
+		size_t size;
+
+		T& operator[](size_t index) const { return data[index*stride]; }
+	};
+
+
+	// The decibels of each frequency (column) of each DFT (row), stored row-major in one
+	// allocation. Every row begins on a 64-byte boundary. Values are stored either as
+	// floats or, to halve the memory, as 16-bit fixed point multiples of the scale.
+	class Spectrogram
+	{
+	public:
+		enum class Format{float32, uint16};
+
+		Spectrogram() = default;
+		Spectrogram(size_t rows, size_t columns,
+			Format format = Format::float32, float scale = 1.f);
+
+		~Spectrogram();
+
+		Spectrogram(const Spectrogram& other);
+		Spectrogram& operator=(const Spectrogram& other);
+		Spectrogram(Spectrogram&& other) noexcept;
+		Spectrogram& operator=(Spectrogram&& other) noexcept;
+
+		void reset(size_t rows, size_t columns);
+
+		void set_format(Format format, float scale = 1.f);
+
+		void reserve(size_t rows);
+
+		size_t append_rows(size_t count);
+
+		void clear();
+
+		void load(size_t row, size_t column, size_t count, float* destination) const;
+
+		void store(size_t row, size_t column, size_t count, const float* source);
+
+		// Float format only.
+		float& operator()(size_t row, size_t column)
+		{ return get_row(row)[column]; }
+
+		float operator()(size_t row, size_t column) const
+		{ return get_row(row)[column]; }
+
+
+		// Getters.
+		float get(size_t row, size_t column) const;
+
+		// Float format only.
+		float* get_row(size_t row)
+		{ return reinterpret_cast<float*>(data+row*stride*element_size); }
+
+		const float* get_row(size_t row) const
+		{ return reinterpret_cast<const float*>(data+row*stride*element_size); }
+
+		ColumnView<float> get_column(size_t column)
+		{ return {get_row(0)+column, stride, rows}; }
+
+		ColumnView<const float> get_column(size_t column) const
+		{ return {get_row(0)+column, stride, rows}; }
+
+		size_t get_rows() const { return rows; }
+
+		size_t get_columns() const { return columns; }
+
+		size_t get_stride() const { return stride; }
+
+		Format get_format() const { return format; }
+
+		float get_scale() const { return scale; }
+
+		size_t get_memory_size() const { return capacity*stride*element_size; }
+
+		bool empty() const { return rows == 0; }
+
+	private:
+		uint8_t* data{nullptr};
+		size_t rows{};
+		size_t columns{};
+		size_t stride{}; // Elements.
+		size_t capacity{}; // Rows.
+		Format format{Format::float32};
+		size_t element_size{sizeof(float)}; // Bytes.
+		float scale{1.f};
+
+		void reallocate(size_t capacity);
+	};
+}
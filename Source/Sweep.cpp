@@ -0,0 +1,265 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#include "Sweep.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "Constants.hpp"
+#include "Decoder.hpp"
+#include "Generator.hpp"
+#include "Exporter.hpp"
+#include "ThreadPool.hpp"
+
+
+namespace
+{
+	struct Variant
+	{
+		LV::GeneratorConfiguration configuration;
+		std::string name_suffix;
+	};
+
+	// Variants with the same harmonic smoothing, which only differ in their temporal
+	// smoothing and meshes. Each unit is generated in order by one generator, which
+	// reuses its harmonically smoothed DFT data, and the smoothed DFT data of adjacent
+	// variants with the same temporal smoothing.
+	using Unit = std::vector<Variant>;
+
+	// Units with the same DFT settings, which only differ in their harmonic smoothing.
+	using Group = std::vector<Unit>;
+
+
+	std::mutex output_mutex;
+
+
+	std::vector<std::string> split_list(const std::string& list)
+	{
+		std::vector<std::string> values;
+		std::istringstream stream{list};
+
+		for(std::string value; std::getline(stream, value, ',');)
+			if(!value.empty()) values.emplace_back(value);
+
+		if(values.empty()) throw std::runtime_error{"Empty list \""+list+"\"."};
+		return values;
+	}
+
+
+	// Returns every combination of the listed values, validated as they would be by
+	// 'configure'.
+	std::vector<Variant> get_variants(const LV::GeneratorConfiguration& configuration,
+		const std::vector<std::string>& lists)
+	{
+		if(lists.size() != 6) throw std::runtime_error{"A sweep requires six lists."};
+
+		std::vector<std::vector<std::string>> values;
+		for(const std::string& list : lists) values.emplace_back(split_list(list));
+
+		std::vector<Variant> variants;
+		std::vector<size_t> indices(values.size());
+
+		while(true)
+		{
+			std::vector<std::string> tokens;
+			for(size_t index{}; index < values.size(); ++index)
+				tokens.emplace_back(values[index][indices[index]]);
+
+			Variant variant{configuration, {}};
+			LV::Generator::configure(&variant.configuration, std::stof(tokens[0]),
+				std::stof(tokens[1]), std::stof(tokens[2]), std::stof(tokens[3]),
+				std::stof(tokens[4]), tokens[5]);
+
+			for(const std::string& token : tokens) variant.name_suffix += "_"+token;
+			variants.emplace_back(std::move(variant));
+
+			// Advance to the next combination, the last list changing fastest.
+			size_t index{values.size()};
+			while(index > 0 && ++indices[index-1] == values[index-1].size())
+				indices[--index] = 0;
+
+			if(index == 0) break;
+		}
+
+		return variants;
+	}
+
+
+	// Groups the variants by the stages they share.
+	std::vector<Group> get_groups(const std::vector<Variant>& variants)
+	{
+		std::vector<Group> groups;
+
+		for(const Variant& variant : variants)
+		{
+			const LV::GeneratorConfiguration& configuration{variant.configuration};
+
+			auto group{std::find_if(groups.begin(), groups.end(), [&](const Group& group)
+			{
+				const LV::GeneratorConfiguration& other{group[0][0].configuration};
+				return configuration.dft_window_duration == other.dft_window_duration &&
+					configuration.dft_sample_interval == other.dft_sample_interval;
+			})};
+
+			if(group == groups.end()) group = groups.insert(groups.end(), Group{});
+
+			auto unit{std::find_if(group->begin(), group->end(), [&](const Unit& unit)
+			{
+				const LV::GeneratorConfiguration& other{unit[0].configuration};
+				return configuration.harmonic_smoothing == other.harmonic_smoothing &&
+					configuration.smoothing_kernel == other.smoothing_kernel;
+			})};
+
+			if(unit == group->end()) unit = group->insert(group->end(), Unit{});
+			unit->emplace_back(variant);
+		}
+
+		return groups;
+	}
+
+
+	// Returns the number of units to generate at once, as many as the threads and the
+	// memory budget allow. Audio of unknown length is generated one unit at a time.
+	size_t get_concurrency(const LV::GeneratorConfiguration& configuration,
+		int sample_rate, size_t sample_count, size_t unit_count)
+	{
+		if(sample_count == 0) return 1;
+
+		const LV::Generator generator{configuration};
+		const size_t memory{generator.estimate_memory(sample_rate, sample_count)+
+			LV::Exporter::estimate_memory(generator.estimate_vertex_count(
+			sample_rate, sample_count))};
+
+		const size_t affordable{memory > 0 ? LV::Constants::batch_memory_budget/memory : 1};
+
+		return std::max<size_t>(std::min<size_t>({unit_count, affordable,
+			LV::ThreadPool::get_thread_count()}), 1);
+	}
+}
+
+
+// Generates and exports every combination of the listed 'configure' values for one
+// audio file. The audio is decoded once and transformed once for each distinct DFT
+// window duration and sample interval. The harmonic smoothing variants of each
+// transform are then generated concurrently, each sharing the transform, and each
+// harmonic smoothing is reused by the variants that only differ in their temporal
+// smoothing or meshes.
+void LV::Sweep::run(const GeneratorConfiguration& configuration,
+	const std::string& file_name, const std::string& format,
+	const std::string& orientation, const std::vector<std::string>& lists)
+{
+	LV::Exporter::validate_options(format, orientation);
+
+	const std::vector<Variant> variants{get_variants(configuration, lists)};
+	const std::vector<Group> groups{get_groups(variants)};
+	std::cout<<"Sweeping "<<variants.size()<<" variants in "<<groups.size()<<
+		(groups.size() == 1 ? " transform.\n" : " transforms.\n");
+
+	const auto start{std::chrono::steady_clock::now()};
+	std::atomic<int> completed{};
+	std::atomic<int> failed{};
+
+	const auto export_variant{[&](LV::Generator* generator, const Variant& variant)
+	{
+		try
+		{
+			generator->set_configuration(variant.configuration);
+			LV::Exporter::export_model(generator, file_name,
+				format, orientation, 0.f, 0.f, variant.name_suffix);
+
+			std::lock_guard<std::mutex> lock{output_mutex};
+			std::cout<<"Exported variant"<<variant.name_suffix<<" ("<<++completed<<"/"<<
+				variants.size()<<").\n";
+		}
+		catch(std::exception& error)
+		{
+			std::lock_guard<std::mutex> lock{output_mutex};
+			std::cout<<"ERROR: Variant"<<variant.name_suffix<<": "<<error.what()<<'\n';
+			++failed;
+		}
+	}};
+
+	// Find the audio's length to estimate the memory used by each variant.
+	const LV::Decoder decoder{file_name,
+		static_cast<unsigned>(configuration.draft_sample_rate)};
+	const int sample_rate{decoder.get_sample_rate()};
+	const size_t sample_count{decoder.get_estimated_sample_count()};
+
+	// The primary generator keeps the decoded audio memoized between transforms.
+	LV::Generator primary{configuration};
+
+	for(const Group& group : groups)
+	{
+		// Transform the audio for the group, even if the first variant is cached, so the
+		// other units never transform it themselves.
+		if(group.size() > 1)
+		{
+			try
+			{
+				primary.set_configuration(group[0][0].configuration);
+				primary.transform(file_name);
+			}
+			catch(std::exception& error)
+			{
+				std::lock_guard<std::mutex> lock{output_mutex};
+				std::cout<<"ERROR: "<<error.what()<<'\n';
+			}
+		}
+
+		export_variant(&primary, group[0][0]);
+
+		// Give the other units the transform, then generate the units concurrently. The
+		// primary generator continues with the first unit, which shares its harmonic
+		// smoothing.
+		std::vector<std::unique_ptr<LV::Generator>> generators(group.size());
+		for(size_t index{1}; index < group.size(); ++index)
+		{
+			generators[index] = std::make_unique<LV::Generator>(
+				group[index][0].configuration);
+			primary.share_raw_dft_data(generators[index].get());
+		}
+
+		std::atomic<size_t> next_unit{};
+
+		const auto run_units{[&]
+		{
+			while(true)
+			{
+				const size_t index{next_unit++};
+				if(index >= group.size()) break;
+
+				LV::Generator* generator{index == 0 ? &primary : generators[index].get()};
+				for(size_t variant{index == 0 ? 1u : 0u}; variant < group[index].size();
+					++variant) export_variant(generator, group[index][variant]);
+
+				if(index > 0) generators[index].reset();
+			}
+		}};
+
+		const size_t thread_count{get_concurrency(group[0][0].configuration,
+			sample_rate, sample_count, group.size())};
+
+		std::vector<std::thread> threads;
+		for(size_t index{1}; index < thread_count; ++index) threads.emplace_back(run_units);
+		run_units();
+		for(std::thread& thread : threads) thread.join();
+	}
+
+	// Print the summary.
+	const float seconds{std::chrono::duration<float>(
+		std::chrono::steady_clock::now()-start).count()};
+
+	std::cout<<"Sweep finished: "<<completed<<" exported, "<<failed<<" failed, in "<<
+		seconds<<" seconds.\n";
+}
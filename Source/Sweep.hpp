@@ -0,0 +1,26 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+namespace LV
+{
+	struct GeneratorConfiguration;
+}
+
+
+namespace LV::Sweep
+{
+	// Each list holds the comma-separated values of one 'configure' parameter, in order.
+	void run(const GeneratorConfiguration& configuration, const std::string& file_name,
+		const std::string& format, const std::string& orientation,
+		const std::vector<std::string>& lists);
+}
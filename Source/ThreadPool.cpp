@@ -0,0 +1,171 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+#include <exception>
+
+
+namespace
+{
+	// Tracks the tasks remaining in one parallel_for call.
+	struct Job
+	{
+		std::atomic<size_t> remaining;
+		std::mutex exception_mutex;
+		std::exception_ptr exception;
+	};
+
+	struct Task
+	{
+		Job* job;
+		const LV::ThreadPool::RangeFunction* function;
+		size_t begin;
+		size_t end;
+	};
+
+
+	// The process-wide workers, started on first use and joined at exit.
+	struct Pool
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<Task> tasks;
+		std::vector<std::thread> threads;
+		bool stopping{false};
+
+		Pool();
+		~Pool();
+	};
+
+
+	void run(const Task& task)
+	{
+		try{ (*task.function)(task.begin, task.end); }
+		catch(...)
+		{
+			std::lock_guard<std::mutex> lock{task.job->exception_mutex};
+			if(!task.job->exception) task.job->exception = std::current_exception();
+		}
+
+		task.job->remaining.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+
+	// Pops and runs one queued task, returning false if there were none.
+	bool run_queued_task(Pool* pool)
+	{
+		Task task;
+
+		{
+			std::lock_guard<std::mutex> lock{pool->mutex};
+			if(pool->tasks.empty()) return false;
+			task = pool->tasks.front();
+			pool->tasks.pop_front();
+		}
+
+		run(task);
+
+		// Synchronize with any thread between checking for completion and waiting.
+		{ std::lock_guard<std::mutex> lock{pool->mutex}; }
+		pool->condition.notify_all();
+		return true;
+	}
+
+
+	Pool::Pool()
+	{
+		const unsigned worker_count{std::max(std::thread::hardware_concurrency(), 1u)-1};
+
+		for(unsigned index{}; index < worker_count; ++index) threads.emplace_back([this]
+		{
+			std::unique_lock<std::mutex> lock{mutex};
+
+			while(true)
+			{
+				condition.wait(lock, [this]{ return stopping || !tasks.empty(); });
+				if(stopping) return;
+
+				lock.unlock();
+				run_queued_task(this);
+				lock.lock();
+			}
+		});
+	}
+
+
+	Pool::~Pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			stopping = true;
+		}
+
+		condition.notify_all();
+		for(std::thread& thread : threads) thread.join();
+	}
+
+
+	Pool& get_pool()
+	{
+		static Pool pool;
+		return pool;
+	}
+}
+
+
+// Splits [0, count) into ranges of about grain_size indices and runs the function over
+// them on the pool. The calling thread runs queued tasks while it waits, so parallel
+// loops may be nested. The first exception thrown by the function is rethrown here.
+void LV::ThreadPool::parallel_for(size_t count, size_t grain_size, const RangeFunction& function)
+{
+	if(count == 0) return;
+	grain_size = std::max(grain_size, size_t{1});
+
+	Pool& pool{get_pool()};
+	if(pool.threads.empty() || count <= grain_size)
+	{
+		function(0, count);
+		return;
+	}
+
+	// Queue the tasks.
+	Job job;
+	const size_t task_count{(count+grain_size-1)/grain_size};
+	job.remaining = task_count;
+
+	{
+		std::lock_guard<std::mutex> lock{pool.mutex};
+		for(size_t begin{}; begin < count; begin += grain_size)
+			pool.tasks.push_back({&job, &function, begin, std::min(begin+grain_size, count)});
+	}
+
+	pool.condition.notify_all();
+
+	// Help until every task of this job has finished.
+	while(job.remaining.load(std::memory_order_acquire) > 0)
+	{
+		if(run_queued_task(&pool)) continue;
+
+		std::unique_lock<std::mutex> lock{pool.mutex};
+		pool.condition.wait(lock, [&]{ return !pool.tasks.empty() ||
+			job.remaining.load(std::memory_order_acquire) == 0; });
+	}
+
+	if(job.exception) std::rethrow_exception(job.exception);
+}
+
+
+unsigned LV::ThreadPool::get_thread_count()
+{ return static_cast<unsigned>(get_pool().threads.size())+1; }
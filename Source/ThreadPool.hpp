@@ -0,0 +1,23 @@
+/*
+	Copyright 2020 Myles Trevino
+	Licensed under the Apache License, Version 2.0
+	https://www.apache.org/licenses/LICENSE-2.0
+*/
+
+
+#pragma once
+
+#include <functional>
+
+
+namespace LV::ThreadPool
+{
+	// Receives the half-open range [begin, end) of indices to process.
+	using RangeFunction = std::function<void(size_t begin, size_t end)>;
+
+
+	void parallel_for(size_t count, size_t grain_size, const RangeFunction& function);
+
+	// Getters.
+	unsigned get_thread_count();
+}
@@ -8,11 +8,16 @@
 #include "Utilities.hpp"
 
 #include <sstream>
+#include <regex>
+#include <filesystem>
 #ifdef _WIN32
 #define NOMINMAX
 #include <Windows.h>
-#elif __APPLE__
+#else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 #include <glbinding/gl33core/gl.h>
 #include <globjects/VertexAttributeBinding.h>
@@ -130,7 +135,98 @@ void LV::Utilities::destroy_vao(VAO* vao)
 }
 
 
+void LV::Utilities::map_file(MappedFile* mapped_file, const std::string& path)
+{
+	*mapped_file = {};
+
+	#ifdef _WIN32
+	// Open the file.
+	HANDLE file{CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr)};
+
+	if(file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error{"Could not open the file \""+path+"\"."};
+
+	mapped_file->file_handle = file;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size))
+	{
+		unmap_file(mapped_file);
+		throw std::runtime_error{"Could not get the size of the file \""+path+"\"."};
+	}
+
+	mapped_file->size = static_cast<size_t>(size.QuadPart);
+	if(mapped_file->size == 0) return;
+
+	// Map the file.
+	mapped_file->mapping_handle = CreateFileMappingA(
+		file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if(mapped_file->mapping_handle) mapped_file->data = static_cast<const uint8_t*>(
+		MapViewOfFile(mapped_file->mapping_handle, FILE_MAP_READ, 0, 0, 0));
+
+	#else
+	// Open the file.
+	const int file{open(path.c_str(), O_RDONLY)};
+	if(file < 0) throw std::runtime_error{"Could not open the file \""+path+"\"."};
+
+	struct stat status;
+	if(fstat(file, &status) != 0)
+	{
+		close(file);
+		throw std::runtime_error{"Could not get the size of the file \""+path+"\"."};
+	}
+
+	mapped_file->size = static_cast<size_t>(status.st_size);
+	if(mapped_file->size == 0){ close(file); return; }
+
+	// Map the file. The mapping remains valid after the descriptor is closed.
+	void* data{mmap(nullptr, mapped_file->size, PROT_READ, MAP_PRIVATE, file, 0)};
+	close(file);
+
+	if(data != MAP_FAILED) mapped_file->data = static_cast<const uint8_t*>(data);
+	#endif
+
+	if(!mapped_file->data)
+	{
+		unmap_file(mapped_file);
+		throw std::runtime_error{"Could not map the file \""+path+"\"."};
+	}
+}
+
+
+void LV::Utilities::unmap_file(MappedFile* mapped_file)
+{
+	#ifdef _WIN32
+	if(mapped_file->data) UnmapViewOfFile(mapped_file->data);
+	if(mapped_file->mapping_handle) CloseHandle(mapped_file->mapping_handle);
+	if(mapped_file->file_handle) CloseHandle(mapped_file->file_handle);
+
+	#else
+	if(mapped_file->data) munmap(const_cast<uint8_t*>(mapped_file->data), mapped_file->size);
+	#endif
+
+	*mapped_file = {};
+}
+
+
+// Identifies the file's contents by its absolute path, size, and modification time.
+std::string LV::Utilities::get_file_signature(const std::string& path)
+{
+	const std::filesystem::path absolute_path{std::filesystem::absolute(path)};
+
+	return absolute_path.string()+"\n"+std::to_string(std::filesystem::file_size(
+		absolute_path))+"\n"+std::to_string(std::filesystem::last_write_time(
+		absolute_path).time_since_epoch().count());
+}
+
+
 std::vector<uint8_t> LV::Utilities::compress(const std::string& source)
+{ return compress(source, ZSTD_maxCLevel()); }
+
+
+std::vector<uint8_t> LV::Utilities::compress(const std::string& source, int level)
 {
 	// Allocate the destination buffer.
 	const size_t buffer_size{ZSTD_compressBound(source.size())};
@@ -138,7 +234,7 @@ std::vector<uint8_t> LV::Utilities::compress(const std::string& source)
 
 	// Compress.
 	const size_t compressed_size{ZSTD_compress(buffer, buffer_size,
-		source.c_str(), source.size(), ZSTD_maxCLevel())};
+		source.c_str(), source.size(), level)};
 
 	if(ZSTD_isError(compressed_size)) throw std::runtime_error{"Failed to compress."};
 
@@ -150,6 +246,12 @@ std::vector<uint8_t> LV::Utilities::compress(const std::string& source)
 }
 
 
+// Estimates the bytes 'compress' allocates besides the source: the worst case
+// destination buffer and the result copied out of it.
+size_t LV::Utilities::estimate_compression_memory(size_t source_size)
+{ return 2*ZSTD_compressBound(source_size); }
+
+
 std::string LV::Utilities::decompress(const std::vector<uint8_t>& source)
 {
 	// Allocate the destination buffer.
@@ -196,3 +298,40 @@ std::vector<std::string> LV::Utilities::split(const std::string& string)
 	return {std::istream_iterator<std::string>(stream), 
 		std::istream_iterator<std::string>()};
 }
+
+
+void LV::Utilities::validate_command_parameters(const std::string& command,
+	int required, size_t given)
+{
+	if(given != required) throw std::runtime_error{"'"+command+"' requires "
+		+std::to_string(required)+(required == 1 ? " parameter" : " parameters")+
+		" but "+(given > 0 ? "only " : "")+std::to_string(given)+
+		(given == 1 ? " was" : " were")+" given."};
+}
+
+
+void LV::Utilities::validate_command_parameters(const std::string& command,
+	int minimum, int maximum, size_t given)
+{
+	if(given < minimum || given > maximum) throw std::runtime_error{"'"+command+
+		"' requires between "+std::to_string(minimum)+" and "+std::to_string(maximum)+
+		" parameters but "+std::to_string(given)+(given == 1 ? " was" : " were")+" given."};
+}
+
+
+// Parses the optional start and end times following the given token.
+std::pair<float, float> LV::Utilities::parse_range(
+	const std::vector<std::string>& tokens, size_t index)
+{
+	return {tokens.size() > index ? std::stof(tokens[index]) : 0.f,
+		tokens.size() > index+1 ? std::stof(tokens[index+1]) : 0.f};
+}
+
+
+void LV::Utilities::validate_audio_file_name(const std::string& name)
+{
+	if(!std::regex_match(name, std::regex{"^[a-zA-Z0-9-.]+.(flac|wav|mp3)$"}))
+		throw std::runtime_error{"Invalid audio file name. The file name must "
+			"consist only of alphanumeric characters, dashes, and periods, and be "
+			"either FLAC, WAV, or MP3."};
+}
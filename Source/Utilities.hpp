@@ -9,6 +9,7 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 #include <globjects/globjects.h>
 #include <globjects/base/File.h>
 #include <glm/glm.hpp>
@@ -31,6 +32,14 @@ namespace LV
 		std::unique_ptr<globjects::Buffer> vbo;
 		std::unique_ptr<globjects::Buffer> ibo;
 	};
+
+	struct MappedFile
+	{
+		const uint8_t* data{nullptr};
+		size_t size{};
+		void* file_handle{nullptr};
+		void* mapping_handle{nullptr};
+	};
 }
 
 
@@ -50,11 +59,23 @@ namespace LV::Utilities
 	void destroy_vao(VAO* vao);
 
 
+	// Memory mapping.
+	void map_file(MappedFile* mapped_file, const std::string& path);
+
+	void unmap_file(MappedFile* mapped_file);
+
+	std::string get_file_signature(const std::string& path);
+
+
 	// Compression.
 	std::vector<uint8_t> compress(const std::string& source);
 
+	std::vector<uint8_t> compress(const std::string& source, int level);
+
 	std::string decompress(const std::vector<uint8_t>& source);
 
+	size_t estimate_compression_memory(size_t source_size);
+
 	// Streams.
 	void ignore_until(std::istream* stream, char delimiter);
 
@@ -63,4 +84,14 @@ namespace LV::Utilities
 		const std::vector<std::string>& supported_options);
 
 	std::vector<std::string> split(const std::string& string);
+
+	// Commands.
+	void validate_command_parameters(const std::string& command, int required, size_t given);
+
+	void validate_command_parameters(const std::string& command,
+		int minimum, int maximum, size_t given);
+
+	std::pair<float, float> parse_range(const std::vector<std::string>& tokens, size_t index);
+
+	void validate_audio_file_name(const std::string& name);
 }
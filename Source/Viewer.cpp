@@ -8,6 +8,9 @@
 #include "Viewer.hpp"
 
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include <GLFW/glfw3.h>
 #include <glbinding/gl33core/gl.h>
 #include <glm/gtx/rotate_vector.hpp>
@@ -25,9 +28,21 @@ namespace
 	constexpr float light_rotation_limit{glm::radians(85.f)};
 
 	glm::fvec2 dft_size;
+	float dft_height;
 	LV::Mesh dft_mesh;
 	LV::Mesh base_mesh;
 
+	// Finer levels of detail are generated in the background and handed over to be
+	// buffered by the rendering thread.
+	std::thread generation_thread;
+	std::atomic<bool> generation_cancelled;
+	std::mutex level_mutex;
+	bool level_pending;
+	glm::fvec2 pending_dft_size;
+	float pending_dft_height;
+	LV::Mesh pending_dft_mesh;
+	LV::Mesh pending_base_mesh;
+
 	LV::VAO dft_vao;
 	LV::VAO base_vao;
 	LV::Shader shadow_shader;
@@ -140,7 +155,7 @@ namespace
 		bind_matricies_and_shadow_map(dft_shader);
 		dft_shader.program->setUniform("light_direction", light_direction);
 		dft_shader.program->setUniform("color", color);
-		dft_shader.program->setUniform("dft_height", LV::Generator::get_height());
+		dft_shader.program->setUniform("dft_height", dft_height);
 		dft_shader.program->use();
 	}
 
@@ -179,6 +194,64 @@ namespace
 	}
 
 
+	// Called on the generation thread once each level of detail is generated.
+	void receive_level(const LV::Generator& generator, int level)
+	{
+		std::lock_guard<std::mutex> lock{level_mutex};
+		pending_dft_size = generator.get_size();
+		pending_dft_height = generator.get_height();
+		pending_dft_mesh = generator.get_dft_mesh();
+		pending_base_mesh = generator.get_base_mesh();
+		level_pending = true;
+
+		if(level == 0) std::cout<<"Generated the full resolution model.\n";
+	}
+
+
+	// Buffers the latest level of detail received from the generation thread.
+	void update_level()
+	{
+		{
+			std::lock_guard<std::mutex> lock{level_mutex};
+			if(!level_pending) return;
+
+			dft_size = pending_dft_size;
+			dft_height = pending_dft_height;
+			dft_mesh = std::move(pending_dft_mesh);
+			base_mesh = std::move(pending_base_mesh);
+			level_pending = false;
+		}
+
+		LV::Utilities::destroy_vao(&base_vao);
+		LV::Utilities::destroy_vao(&dft_vao);
+
+		LV::Utilities::create_vao(&dft_vao, dft_shader,
+			dft_mesh.vertices, dft_mesh.indices);
+
+		LV::Utilities::create_vao(&base_vao, dft_shader,
+			base_mesh.vertices, base_mesh.indices);
+
+		recalculate_lighting();
+	}
+
+
+	// Cancels the background generation and waits for it to finish.
+	void stop_generation()
+	{
+		if(!generation_thread.joinable()) return;
+		generation_cancelled = true;
+		generation_thread.join();
+	}
+
+
+	// Stops the background generation when the viewer exits, including by an exception,
+	// so the thread never outlives the generator it uses.
+	struct GenerationGuard
+	{
+		~GenerationGuard(){ stop_generation(); }
+	};
+
+
 	void wireframe_pass()
 	{
 		bind_solid_shader(LV::Constants::wireframe_color, .5f, glm::fvec3{0.f, .1f, 0.f});
@@ -189,19 +262,23 @@ namespace
 }
 
 
-void LV::Viewer::view(const std::string& name)
+void LV::Viewer::view(Generator* generator, const std::string& name, float start, float end)
 {
-	// Load the Resonance mesh.
-	LV::Generator::generate(name);
-	dft_size = LV::Generator::get_size();
-	dft_mesh = LV::Generator::get_dft_mesh();
-	base_mesh = LV::Generator::get_base_mesh();
+	// Load the Resonance mesh. If a coarse preview can be generated, it is shown while
+	// the finer levels of detail are generated in the background.
+	const bool preview{generator->generate_preview(name, start, end)};
+	if(!preview) generator->generate(name, start, end);
+
+	dft_size = generator->get_size();
+	dft_height = generator->get_height();
+	dft_mesh = generator->get_dft_mesh();
+	base_mesh = generator->get_base_mesh();
 
 	// Initialize.
 	light_direction = base_light_direction;
 	light_rotation = LV::Constants::initial_light_rotation;
 
-	Camera::set(glm::fvec3{0.f, LV::Generator::get_height()+1000.f, 0.f},
+	Camera::set(glm::fvec3{0.f, dft_height+1000.f, 0.f},
 		LV::Constants::default_camera_axes,
 		LV::Constants::default_camera_fov);
 
@@ -229,6 +306,26 @@ void LV::Viewer::view(const std::string& name)
 	create_shadow_buffer();
 	recalculate_lighting();
 
+	// Start generating the finer levels of detail.
+	level_pending = false;
+	generation_cancelled = false;
+	const GenerationGuard generation_guard{};
+
+	if(preview) generation_thread = std::thread{[=]
+	{
+		const auto on_level{[=](int level){ receive_level(*generator, level); }};
+
+		try{ generator->generate(name, start, end, on_level, &generation_cancelled); }
+		catch(std::exception& error)
+		{
+			if(!generation_cancelled) std::cout<<"ERROR: "<<error.what()<<'\n';
+		}
+		catch(...)
+		{
+			if(!generation_cancelled) std::cout<<"ERROR: Unhandled exception.\n";
+		}
+	}};
+
 	// While the window is open...
 	std::cout<<"Rendering...\n";
 	while(Window::is_open())
@@ -236,6 +333,7 @@ void LV::Viewer::view(const std::string& name)
 		// Update.
 		Window::update();
 		if(Window::is_minimized()) continue;
+		update_level();
 
 		// Input.
 		Camera::update();
@@ -260,6 +358,8 @@ void LV::Viewer::view(const std::string& name)
 	}
 
 	// Destroy.
+	stop_generation();
+
 	shadow_map_fbo.reset();
 	shadow_map.reset();
 	
@@ -10,7 +10,14 @@
 #include <string>
 
 
+namespace LV
+{
+	class Generator;
+}
+
+
 namespace LV::Viewer
 {
-	void view(const std::string& name);
+	void view(Generator* generator, const std::string& name,
+		float start = 0.f, float end = 0.f);
 }
\ No newline at end of file